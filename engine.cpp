@@ -1,17 +1,28 @@
 #include "libraries/chess.hpp"
 #include "search.hpp"
+#include "mate.hpp"
+#include "mcts.hpp"
 #include <map>
 #include <string>
 #include <climits>
 #include <chrono>
 #include <ctime>
+#include <cstdlib>
+#include <thread>
 
 using namespace chess;
 
 void gameLoop(Board& board);
 void playEngineWhite(Board& board);
 void playEngineBlack(Board& board);
-Move getEngineMove(Board& board, int depth, bool max);
+Move getEngineMove(Board& board, const SearchLimits &limits);
+void startClocks(SearchLimits &clocks);
+void chargeClock(SearchLimits &clocks, Color color, std::chrono::steady_clock::time_point moveStart);
+void startPondering(const Board& board, Move engineMove, const SearchLimits &clocks);
+Move finishPondering(Move playerMove);
+void printSearchStats();
+void printLines();
+void solveMate(const std::string &fen, int maxMoves);
 Move getMove(Board& board);
 bool isMoveLegal(Board& board, Move& move);
 void printBoard(Board &board, Color color);
@@ -36,10 +47,83 @@ std::map<chess::Piece, std::string> pieceCodeMap =
 
 Color playerColor;
 
-int main() {
+const int HASH_SIZE_MB = 64;
+const int MATE_HASH_SIZE_MB = 64;
+const uint64_t MATE_NODE_LIMIT = 10000000;
+const int64_t ENGINE_MOVE_TIME_MS = 2000;
+const int TEST_SEARCH_DEPTH = 5;
+const int64_t GAME_TIME_MS = 5 * 60 * 1000;
+const int64_t GAME_INCREMENT_MS = 3000;
+
+// Search on the opponent's time: ponderThread searches the position after
+// ponderMove, the reply the last search expected, and leaves its move in ponderResult
+std::thread ponderThread;
+Move ponderMove = Move::NO_MOVE;
+Move ponderResult = Move::NO_MOVE;
+
+RootDriver rootDriver = RootDriver::Aspiration;
+bool useMcts = false;
+bool deterministic = false;
+int multiPV = 1;
+
+int main(int argc, char* argv[]) {
+    tt.resize(HASH_SIZE_MB);
+
+    // Number of search threads, e.g. "./engine 8"
+    int threads = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 1;
+    setThreadCount(threads);
+
+    // Mate query, e.g. "./engine 1 mate '<fen>' 3" for a mate in 3 or less
+    if (argc > 3 && std::string(argv[2]) == "mate") {
+        solveMate(argv[3], (argc > 4) ? std::atoi(argv[4]) : 0);
+        return 0;
+    }
+
+    // Root driver, e.g. "./engine 1 mtdf", or "./engine 8 mcts" for tree search instead of alpha-beta
+    if (argc > 2 && std::string(argv[2]) == "mtdf") {
+        rootDriver = RootDriver::MTDF;
+    }
+    if (argc > 2 && std::string(argv[2]) == "mcts") {
+        useMcts = true;
+        mcts.resize(HASH_SIZE_MB);
+    }
+
+    // Best lines to report, e.g. "./engine 1 multipv 3"
+    if (argc > 3 && std::string(argv[2]) == "multipv") {
+        multiPV = std::max(1, std::atoi(argv[3]));
+    }
+
+    // Reproducible parallel search, e.g. "./engine 4 det"
+    if (argc > 2 && std::string(argv[2]) == "det") {
+        deterministic = true;
+    }
+
+    // Limit for the test search, e.g. "./engine 1 nodes 1000000" for a reproducible
+    // benchmark, "./engine 1 depth 8" or "./engine 1 movetime 5000"
+    SearchLimits limits;
+    limits.depth = TEST_SEARCH_DEPTH;
+    if (useMcts) {
+        limits.moveTimeMs = ENGINE_MOVE_TIME_MS;
+    }
+    if (argc > 3 && std::string(argv[2]) == "depth") {
+        limits.depth = std::atoi(argv[3]);
+    }
+    if (argc > 3 && std::string(argv[2]) == "nodes") {
+        limits.depth = 0;
+        limits.nodes = std::strtoull(argv[3], nullptr, 10);
+    }
+    if (argc > 3 && std::string(argv[2]) == "movetime") {
+        limits.depth = 0;
+        limits.moveTimeMs = std::atoll(argv[3]);
+    }
+
     Board board = Board(chess::constants::STARTPOS);
-    int test = minimax(board, 5, INT_MIN, INT_MAX, true);
-    std::cout << test << std::endl;
+    Move test = getEngineMove(board, limits);
+    if (!useMcts) {
+        printLines();
+    }
+    std::cout << uci::moveToUci(test) << std::endl;
+    printSearchStats();
     return 0;
 }
 
@@ -57,14 +141,23 @@ void gameLoop(Board& board) {
 void playEngineWhite(Board& board) {
     bool whitesTurn = true;
     Move lastEngMove = Move::NULL_MOVE;
+    Move lastPlayerMove = Move::NO_MOVE;
+    SearchLimits clocks;
+    startClocks(clocks);
 
     while(true) {
+        const auto moveStart = std::chrono::steady_clock::now();
+
         if (whitesTurn) { // Engine
             whitesTurn = false;
 
-            Move engineMove(getEngineMove(board, 5, true));
+            Move engineMove = finishPondering(lastPlayerMove);
+            if (engineMove == Move::NO_MOVE) {
+                engineMove = getEngineMove(board, clocks);
+            }
             board.makeMove(engineMove);
             lastEngMove = engineMove;
+            chargeClock(clocks, Color::WHITE, moveStart);
         } else {
             whitesTurn = true;
 
@@ -73,7 +166,10 @@ void playEngineWhite(Board& board) {
                 std::cout << "Engine Move: " << lastEngMove.from() << lastEngMove.to() << std::endl;
             }
 
-            board.makeMove(getMove(board));
+            startPondering(board, lastEngMove, clocks);
+            lastPlayerMove = getMove(board);
+            board.makeMove(lastPlayerMove);
+            chargeClock(clocks, Color::BLACK, moveStart);
         }
     }
 }
@@ -81,8 +177,13 @@ void playEngineWhite(Board& board) {
 void playEngineBlack(Board& board) {
     bool whitesTurn = true;
     Move lastEngMove = Move::NULL_MOVE;
+    Move lastPlayerMove = Move::NO_MOVE;
+    SearchLimits clocks;
+    startClocks(clocks);
 
     while (true) {
+        const auto moveStart = std::chrono::steady_clock::now();
+
         if (whitesTurn) { // Player
             whitesTurn = false;
 
@@ -91,38 +192,150 @@ void playEngineBlack(Board& board) {
                 std::cout << "Engine Move: " << lastEngMove.from() << lastEngMove.to() << std::endl;
             }
 
-            board.makeMove(getMove(board));
+            startPondering(board, lastEngMove, clocks);
+            lastPlayerMove = getMove(board);
+            board.makeMove(lastPlayerMove);
+            chargeClock(clocks, Color::WHITE, moveStart);
         } else {
             whitesTurn = true;
 
-            Move engineMove = getEngineMove(board, 5, false);
+            Move engineMove = finishPondering(lastPlayerMove);
+            if (engineMove == Move::NO_MOVE) {
+                engineMove = getEngineMove(board, clocks);
+            }
             board.makeMove(engineMove);
             lastEngMove = engineMove;
+            chargeClock(clocks, Color::BLACK, moveStart);
         }
     }
 }
 
-Move getEngineMove(Board& board, int depth, bool max) {
-    int bestValue = INT_MIN;
-    Move bestMove;
+void startClocks(SearchLimits &clocks) {
+    clocks.whiteTimeMs = GAME_TIME_MS;
+    clocks.blackTimeMs = GAME_TIME_MS;
+    clocks.whiteIncrementMs = GAME_INCREMENT_MS;
+    clocks.blackIncrementMs = GAME_INCREMENT_MS;
+}
 
-    Movelist moves;
-    movegen::legalmoves(moves, board);
+// Takes the time a move took off its side's clock and adds the increment. A clock
+// that ran out keeps a millisecond, an empty clock would mean no limit at all.
+void chargeClock(SearchLimits &clocks, Color color, std::chrono::steady_clock::time_point moveStart) {
+    const int64_t spent = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - moveStart).count();
 
-    for (int i = 0; i < moves.size(); i++) {
-        const auto move = moves[i];
+    int64_t &time = color == Color::WHITE ? clocks.whiteTimeMs : clocks.blackTimeMs;
+    const int64_t increment = color == Color::WHITE ? clocks.whiteIncrementMs : clocks.blackIncrementMs;
+    time = std::max<int64_t>(time - spent + increment, 1);
+}
 
-        board.makeMove(move);
-        int value = minimax(board, depth, INT_MIN, INT_MAX, max);
-        board.unmakeMove(move);
+// Starts searching the reply the engine's last search expected while the player
+// thinks. Needs a principal variation going past the engine's move, so searches
+// that don't report lines (MCTS, the deterministic search) never ponder.
+void startPondering(const Board& board, Move engineMove, const SearchLimits &clocks) {
+    if (searchInfo.lines.empty() || searchInfo.lines[0].pv.size() < 2 || searchInfo.lines[0].pv[0] != engineMove) {
+        return;
+    }
+
+    ponderMove = searchInfo.lines[0].pv[1];
+    Board pondered = board;
+    pondered.makeMove(ponderMove);
 
-        if (value > bestValue) {
-            bestValue = value;
-            bestMove = move;
+    searchInfo.pondering = true;
+    searchInfo.stopRequested = false;
+    ponderThread = std::thread([pondered, clocks]() mutable {
+        ponderResult = getEngineMove(pondered, clocks);
+    });
+}
+
+// On a ponder hit the search carries on with all it has done so far, now on the
+// engine's clock, and its move is returned. On a miss it is stopped and NO_MOVE
+// returned, the transposition table it filled stays for the search that follows.
+Move finishPondering(Move playerMove) {
+    if (!ponderThread.joinable()) {
+        return Move::NO_MOVE;
+    }
+
+    const bool hit = playerMove == ponderMove;
+    if (hit) {
+        ponderHit();
+    } else {
+        searchInfo.stopRequested = true;
+        searchInfo.pondering = false;
+    }
+
+    ponderThread.join();
+    searchInfo.stopRequested = false;
+
+    return hit ? ponderResult : Move::NO_MOVE;
+}
+
+// One entry point for every search mode and every kind of limit
+Move getEngineMove(Board& board, const SearchLimits &limits) {
+    if (useMcts) {
+        return mcts.search(board, limits);
+    }
+    if (deterministic) {
+        return deterministicSearch(board, limits);
+    }
+    return iterativeDeepening(board, limits, rootDriver, multiPV);
+}
+
+void printSearchStats() {
+    const uint64_t nodes = searchInfo.nodes;
+    const int64_t ms = searchInfo.elapsedMs;
+    const uint64_t nps = ms > 0 ? nodes * 1000 / ms : 0;
+
+    std::cout << "depth " << searchInfo.completedDepth << " nodes " << nodes << " time " << ms << "ms nps " << nps
+              << " root searches " << searchInfo.rootSearches;
+    if (useMcts) {
+        std::cout << " playouts " << mcts.playouts() << " tree nodes " << mcts.treeSize();
+    }
+    std::cout << std::endl;
+}
+
+void printLines() {
+    for (size_t i = 0; i < searchInfo.lines.size(); i++) {
+        const RootMove &line = searchInfo.lines[i];
+        std::cout << "line " << i + 1 << " score " << line.score << " pv";
+        for (const Move &move : line.pv) {
+            std::cout << " " << uci::moveToUci(move);
         }
+        std::cout << std::endl;
+    }
+}
+
+// Tries each length up to the limit, so the mate reported is the shortest.
+// Without a limit it first proves there is a mate at all, then looks for its length.
+void solveMate(const std::string &fen, int maxMoves) {
+    MateSolver solver(MATE_HASH_SIZE_MB);
+    MateResult result;
+    uint64_t nodes = 0;
+
+    if (maxMoves <= 0) {
+        result = solver.solve(Board(fen), 0, MATE_NODE_LIMIT);
+        nodes += result.nodes;
+        maxMoves = result.status == MateStatus::Mate ? MATE_MAX_PLY / 2 : 0;
     }
 
-    return bestMove;
+    int moves = 1;
+    for (; moves <= maxMoves; moves++) {
+        result = solver.solve(Board(fen), moves, MATE_NODE_LIMIT);
+        nodes += result.nodes;
+        if (result.status != MateStatus::NoMate) {
+            break;
+        }
+    }
+
+    if (result.status == MateStatus::Mate) {
+        std::cout << "mate in " << moves << ":";
+        for (const Move &move : result.line) {
+            std::cout << " " << uci::moveToUci(move);
+        }
+        std::cout << std::endl;
+    } else {
+        std::cout << (result.status == MateStatus::NoMate ? "no mate" : "unknown") << std::endl;
+    }
+    std::cout << "nodes " << nodes << std::endl;
 }
 
 Move getMove(Board& board) {
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "libraries/chess.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+const int HISTORY_MAX = 16384;
+const int HISTORY_MAX_BONUS = 1200;
+
+// Correction history entries are eval corrections in units of 1/CORRECTION_GRAIN
+// centipawns, blended in with a weight of at most CORRECTION_MAX_WEIGHT/CORRECTION_SCALE
+const int CORRECTION_HISTORY_SIZE = 16384;
+const int CORRECTION_GRAIN = 256;
+const int CORRECTION_SCALE = 256;
+const int CORRECTION_MAX_WEIGHT = 16;
+const int CORRECTION_MAX = CORRECTION_GRAIN * 32;
+
+// Scores indexed by [piece][to] of the move being scored
+using PieceToHistory = int16_t[12][64];
+
+// Move ordering memory a search thread builds up from beta cutoffs:
+// - butterfly: quiet moves by [color][from][to]
+// - continuation: quiet moves by [piece][to] of the move one or two plies
+//   earlier, then [piece][to] of the move itself
+// - counterMoves: the quiet move that last refuted [piece][to]
+// - captures: captures by [piece][to][captured piece type]
+// - correction: how far static eval has been off by [color][pawn key], see
+//   correctedEval and updateCorrection
+struct HistoryTables {
+    int16_t butterfly[2][64][64];
+    PieceToHistory continuation[12][64];
+    chess::Move counterMoves[12][64];
+    int16_t captures[12][64][6];
+    int16_t correction[2][CORRECTION_HISTORY_SIZE];
+
+    void clear();
+    void age();
+};
+
+int historyBonus(int depth);
+void updateHistory(int16_t &entry, int bonus);
+chess::PieceType capturedType(const chess::Board &board, chess::Move move);
+uint64_t pawnKey(const chess::Board &board);
+int correctedEval(const HistoryTables &history, const chess::Board &board, int rawEval);
+void updateCorrection(HistoryTables &history, const chess::Board &board, int depth, int diff);
+
+void HistoryTables::clear() {
+    std::fill(&butterfly[0][0][0], &butterfly[0][0][0] + sizeof(butterfly) / sizeof(int16_t), 0);
+    std::fill(&continuation[0][0][0][0], &continuation[0][0][0][0] + sizeof(continuation) / sizeof(int16_t), 0);
+    std::fill(&captures[0][0][0], &captures[0][0][0] + sizeof(captures) / sizeof(int16_t), 0);
+    std::fill(&correction[0][0], &correction[0][0] + sizeof(correction) / sizeof(int16_t), 0);
+    std::fill(&counterMoves[0][0], &counterMoves[0][0] + 12 * 64, chess::Move(chess::Move::NO_MOVE));
+}
+
+// Keep some of what was learned in earlier searches
+void HistoryTables::age() {
+    int16_t *tables[] = {&butterfly[0][0][0], &continuation[0][0][0][0], &captures[0][0][0]};
+    size_t sizes[] = {sizeof(butterfly), sizeof(continuation), sizeof(captures)};
+
+    for (int t = 0; t < 3; t++) {
+        for (size_t i = 0; i < sizes[t] / sizeof(int16_t); i++) {
+            tables[t][i] /= 2;
+        }
+    }
+}
+
+int historyBonus(int depth) {
+    return std::min(16 * depth * depth, HISTORY_MAX_BONUS);
+}
+
+// Gravity update: the closer an entry is to HISTORY_MAX the less a bonus moves it,
+// so entries stay bounded and recent results outweigh old ones
+void updateHistory(int16_t &entry, int bonus) {
+    entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+}
+
+chess::PieceType capturedType(const chess::Board &board, chess::Move move) {
+    if (move.typeOf() == chess::Move::ENPASSANT) {
+        return chess::PieceType::PAWN;
+    }
+    return board.at<chess::PieceType>(move.to());
+}
+
+// Hash of the pawn structure alone, mixed so that nearby structures spread
+// over the whole correction table
+uint64_t pawnKey(const chess::Board &board) {
+    uint64_t key = board.pieces(chess::PieceType::PAWN, chess::Color::WHITE).getBits() * 0x9E3779B97F4A7C15ULL;
+    key ^= board.pieces(chess::PieceType::PAWN, chess::Color::BLACK).getBits() + 0xBF58476D1CE4E5B9ULL + (key << 6) + (key >> 2);
+    key ^= key >> 31;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 29;
+    return key;
+}
+
+int correctedEval(const HistoryTables &history, const chess::Board &board, int rawEval) {
+    const int16_t entry = history.correction[(int)board.sideToMove()][pawnKey(board) % CORRECTION_HISTORY_SIZE];
+    return rawEval + entry / CORRECTION_GRAIN;
+}
+
+// Blends the error of the static eval against a search result into the entry,
+// trusting deeper searches more
+void updateCorrection(HistoryTables &history, const chess::Board &board, int depth, int diff) {
+    int16_t &entry = history.correction[(int)board.sideToMove()][pawnKey(board) % CORRECTION_HISTORY_SIZE];
+    const int weight = std::min(depth + 1, CORRECTION_MAX_WEIGHT);
+    const int blended = (entry * (CORRECTION_SCALE - weight) + diff * CORRECTION_GRAIN * weight) / CORRECTION_SCALE;
+    entry = (int16_t)std::clamp(blended, -CORRECTION_MAX, CORRECTION_MAX);
+}
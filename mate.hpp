@@ -0,0 +1,353 @@
+#pragma once
+
+#include "libraries/chess.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Proof and disproof numbers saturate here, a number this large is settled
+const uint32_t PN_INFINITE = 0x3FFFFFFF;
+const int MATE_MAX_PLY = 128;
+const int MATE_BUCKET_SIZE = 4;
+
+enum class MateStatus {
+    Mate,    // the side to move forces mate, line holds the moves
+    NoMate,  // proven that it can't, within the move limit if one was given
+    Unknown  // the node limit ran out first
+};
+
+struct MateResult {
+    MateStatus status = MateStatus::Unknown;
+    std::vector<chess::Move> line;
+    uint64_t nodes = 0;
+};
+
+// Proof and disproof numbers from the point of view of the side to move at
+// the entry's position: phi is the number to prove the mover's goal, delta to
+// disprove it. For the attacker the goal is mating, for the defender escaping.
+struct MateEntry {
+    uint64_t key = 0;
+    uint32_t phi = 1;
+    uint32_t delta = 1;
+    uint64_t work = 0;
+};
+
+// Depth-first proof-number search (df-pn) for forced mates by the side to move.
+// Independent of the alpha-beta search: it has its own table, sized once, and
+// only uses the board and legal move generation.
+class MateSolver {
+public:
+    explicit MateSolver(size_t megabytes);
+
+    // maxMoves limits the search to mates in that many moves, 0 for any length
+    MateResult solve(const chess::Board &board, int maxMoves = 0, uint64_t nodeLimit = 0);
+
+private:
+    struct Child {
+        chess::Move move;
+        uint64_t key;
+        bool draw;
+    };
+
+    void mid(int ply, int remaining, uint32_t thPhi, uint32_t thDelta);
+    bool terminal(int remaining, bool attackerToMove, bool hasMoves, uint32_t &phi, uint32_t &delta) const;
+    void childValues(const Child &child, bool childIsAttacker, uint32_t &phi, uint32_t &delta) const;
+    std::vector<chess::Move> extractLine(int remaining);
+    int shortestWin(int ply, int remaining);
+
+    uint64_t entryKey(uint64_t hash, int remaining) const;
+    const MateEntry *lookup(uint64_t key) const;
+    void store(uint64_t key, uint32_t phi, uint32_t delta, uint64_t work);
+
+    chess::Board board;
+    chess::Color attacker = chess::Color::WHITE;
+    uint64_t nodes = 0;
+    uint64_t nodeLimit = 0;
+    bool stopped = false;
+
+    std::unique_ptr<MateEntry[]> table;
+    size_t buckets = 0;
+};
+
+uint32_t addSaturated(uint32_t a, uint32_t b);
+
+MateSolver::MateSolver(size_t megabytes) {
+    const size_t entries = (megabytes * 1024 * 1024) / sizeof(MateEntry);
+
+    buckets = 1;
+    while (buckets * 2 * MATE_BUCKET_SIZE <= entries) {
+        buckets *= 2;
+    }
+
+    table.reset(new MateEntry[buckets * MATE_BUCKET_SIZE]);
+}
+
+MateResult MateSolver::solve(const chess::Board &position, int maxMoves, uint64_t limit) {
+    board = position;
+    attacker = board.sideToMove();
+    nodes = 0;
+    nodeLimit = limit;
+    stopped = false;
+    std::fill(table.get(), table.get() + buckets * MATE_BUCKET_SIZE, MateEntry{});
+
+    // The mating move is the attacker's last, so a mate in N takes 2N - 1 plies.
+    // Without a limit the remaining plies stay at -1 and never run out.
+    const int remaining = maxMoves > 0 ? 2 * maxMoves - 1 : -1;
+
+    // The root is worked on until it is settled or the node limit stops it
+    mid(0, remaining, PN_INFINITE, PN_INFINITE);
+
+    MateResult result;
+    result.nodes = nodes;
+
+    const MateEntry *root = lookup(entryKey(board.hash(), remaining));
+    if (root && root->phi == 0) {
+        result.status = MateStatus::Mate;
+        result.line = extractLine(remaining);
+    } else if (root && root->delta == 0) {
+        result.status = MateStatus::NoMate;
+    }
+
+    return result;
+}
+
+// Multiple iterative deepening: keeps expanding the most proving child of this
+// node until its proof or disproof number reaches the threshold it was given
+void MateSolver::mid(int ply, int remaining, uint32_t thPhi, uint32_t thDelta) {
+    const uint64_t key = entryKey(board.hash(), remaining);
+    const bool attackerToMove = board.sideToMove() == attacker;
+    const uint64_t startNodes = nodes++;
+
+    if (nodeLimit && nodes >= nodeLimit) {
+        stopped = true;
+        return;
+    }
+
+    chess::Movelist moves;
+    chess::movegen::legalmoves(moves, board);
+
+    uint32_t phi;
+    uint32_t delta;
+    if (ply >= MATE_MAX_PLY - 1 || terminal(remaining, attackerToMove, !moves.empty(), phi, delta)) {
+        if (ply >= MATE_MAX_PLY - 1) {
+            // Too deep to follow, count it as an escape for the defender
+            phi = attackerToMove ? PN_INFINITE : 0;
+            delta = attackerToMove ? 0 : PN_INFINITE;
+        }
+        store(key, phi, delta, 1);
+        return;
+    }
+
+    // Child keys and draws don't change while this node is worked on
+    const int childRemaining = remaining < 0 ? -1 : remaining - 1;
+    std::vector<Child> children;
+    children.reserve(moves.size());
+    for (const auto &move : moves) {
+        board.makeMove(move);
+        const bool draw = board.isRepetition(1) || board.isHalfMoveDraw() || board.isInsufficientMaterial();
+        children.push_back({move, entryKey(board.hash(), childRemaining), draw});
+        board.unmakeMove(move);
+    }
+
+    while (true) {
+        // The mover needs one child that refutes the opponent's goal, the opponent needs all of them
+        uint32_t minDelta = PN_INFINITE;
+        uint32_t secondDelta = PN_INFINITE;
+        uint32_t sumPhi = 0;
+        int best = 0;
+        uint32_t bestPhi = 0;
+
+        for (int i = 0; i < (int)children.size(); i++) {
+            uint32_t childPhi;
+            uint32_t childDelta;
+            childValues(children[i], !attackerToMove, childPhi, childDelta);
+            sumPhi = addSaturated(sumPhi, childPhi);
+
+            if (childDelta < minDelta) {
+                secondDelta = minDelta;
+                minDelta = childDelta;
+                best = i;
+                bestPhi = childPhi;
+            } else if (childDelta < secondDelta) {
+                secondDelta = childDelta;
+            }
+        }
+
+        phi = minDelta;
+        delta = sumPhi;
+
+        if (phi >= thPhi || delta >= thDelta || stopped) {
+            store(key, phi, delta, nodes - startNodes);
+            return;
+        }
+
+        const uint32_t childThPhi = thDelta == PN_INFINITE ? PN_INFINITE : thDelta - delta + bestPhi;
+        const uint32_t childThDelta = std::min(thPhi, addSaturated(secondDelta, 1));
+
+        const chess::Move move = children[best].move;
+        board.makeMove(move);
+        mid(ply + 1, childRemaining, childThPhi, childThDelta);
+        board.unmakeMove(move);
+    }
+}
+
+// Settles nodes without looking at their children: mates, stalemates, and
+// nodes past the last ply a mate within the move limit could be delivered on
+bool MateSolver::terminal(int remaining, bool attackerToMove, bool hasMoves, uint32_t &phi, uint32_t &delta) const {
+    bool attackerWins;
+
+    if (!hasMoves) {
+        attackerWins = !attackerToMove && board.inCheck();
+    } else if (remaining == 0) {
+        attackerWins = false;
+    } else {
+        return false;
+    }
+
+    // Seen from the side to move: its goal is met when it is the one winning
+    const bool moverWins = attackerWins == attackerToMove;
+    phi = moverWins ? 0 : PN_INFINITE;
+    delta = moverWins ? PN_INFINITE : 0;
+    return true;
+}
+
+// A child's numbers from its own side to move's point of view. Draws are
+// decided by the path, so they are never stored, only answered here.
+void MateSolver::childValues(const Child &child, bool childIsAttacker, uint32_t &phi, uint32_t &delta) const {
+    if (child.draw) {
+        phi = childIsAttacker ? PN_INFINITE : 0;
+        delta = childIsAttacker ? 0 : PN_INFINITE;
+        return;
+    }
+
+    const MateEntry *entry = lookup(child.key);
+    phi = entry ? entry->phi : 1;
+    delta = entry ? entry->delta : 1;
+}
+
+// Follows proven children from the root. With a move limit the attacker takes
+// the child that mates soonest and the defender the one that holds out longest,
+// so the line is a main line as long as the mate. Otherwise, or between equally
+// long children, the attacker takes the proof that was cheapest to find and the
+// defender the one that took the most work to refute.
+std::vector<chess::Move> MateSolver::extractLine(int remaining) {
+    std::vector<chess::Move> line;
+
+    while ((int)line.size() < MATE_MAX_PLY) {
+        const bool attackerToMove = board.sideToMove() == attacker;
+        const int childRemaining = remaining < 0 ? -1 : remaining - 1;
+
+        chess::Movelist moves;
+        chess::movegen::legalmoves(moves, board);
+
+        chess::Move best = chess::Move::NO_MOVE;
+        uint64_t bestWork = 0;
+        int bestLength = 0;
+        for (const auto &move : moves) {
+            board.makeMove(move);
+            const bool draw = board.isRepetition(1) || board.isHalfMoveDraw() || board.isInsufficientMaterial();
+            const MateEntry *entry = lookup(entryKey(board.hash(), childRemaining));
+
+            // Only moves into positions the attacker is proven to win: the
+            // defender's escape disproved, or the attacker's mate proved
+            if (draw || !entry || (attackerToMove ? entry->delta != 0 : entry->phi != 0)) {
+                board.unmakeMove(move);
+                continue;
+            }
+
+            const uint64_t work = entry->work;
+            const int length = childRemaining < 0 ? 0 : shortestWin((int)line.size() + 1, childRemaining);
+            board.unmakeMove(move);
+
+            bool better = best == chess::Move::NO_MOVE;
+            if (!better && length != bestLength) {
+                better = attackerToMove ? length < bestLength : length > bestLength;
+            } else if (!better) {
+                better = attackerToMove ? work < bestWork : work > bestWork;
+            }
+
+            if (better) {
+                best = move;
+                bestWork = work;
+                bestLength = length;
+            }
+        }
+
+        if (best == chess::Move::NO_MOVE) {
+            break;
+        }
+
+        line.push_back(best);
+        board.makeMove(best);
+        remaining = childRemaining;
+    }
+
+    for (auto it = line.rbegin(); it != line.rend(); ++it) {
+        board.unmakeMove(*it);
+    }
+
+    return line;
+}
+
+// Fewest plies left with which the attacker still wins from the current
+// position, known to be won with remaining. Shorter limits are proved here if
+// the table doesn't know them yet, within the node limit.
+int MateSolver::shortestWin(int ply, int remaining) {
+    const bool attackerToMove = board.sideToMove() == attacker;
+
+    while (remaining >= 2 && !stopped) {
+        const uint64_t key = entryKey(board.hash(), remaining - 2);
+        const MateEntry *known = lookup(key);
+        if (!known || (known->phi != 0 && known->delta != 0)) {
+            mid(ply, remaining - 2, PN_INFINITE, PN_INFINITE);
+        }
+
+        const MateEntry *entry = lookup(key);
+        if (!entry || (attackerToMove ? entry->phi != 0 : entry->delta != 0)) {
+            break;
+        }
+        remaining -= 2;
+    }
+
+    return remaining;
+}
+
+// Positions with a different number of plies left are different problems
+uint64_t MateSolver::entryKey(uint64_t hash, int remaining) const {
+    return hash ^ ((uint64_t)(remaining + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+const MateEntry *MateSolver::lookup(uint64_t key) const {
+    const MateEntry *bucket = &table[(key & (buckets - 1)) * MATE_BUCKET_SIZE];
+    for (int i = 0; i < MATE_BUCKET_SIZE; i++) {
+        if (bucket[i].key == key && bucket[i].work != 0) {
+            return &bucket[i];
+        }
+    }
+    return nullptr;
+}
+
+// Overwrites the same position if present, otherwise the entry that took the least work
+void MateSolver::store(uint64_t key, uint32_t phi, uint32_t delta, uint64_t work) {
+    MateEntry *bucket = &table[(key & (buckets - 1)) * MATE_BUCKET_SIZE];
+    MateEntry *replace = &bucket[0];
+
+    for (int i = 0; i < MATE_BUCKET_SIZE; i++) {
+        if (bucket[i].key == key) {
+            replace = &bucket[i];
+            work += bucket[i].work;
+            break;
+        }
+        if (bucket[i].work < replace->work) {
+            replace = &bucket[i];
+        }
+    }
+
+    *replace = MateEntry{key, phi, delta, std::max<uint64_t>(work, 1)};
+}
+
+uint32_t addSaturated(uint32_t a, uint32_t b) {
+    return std::min<uint64_t>((uint64_t)a + b, PN_INFINITE);
+}
@@ -0,0 +1,526 @@
+#pragma once
+
+#include "libraries/chess.hpp"
+#include "search.hpp"
+#include "values.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Exploration constant of the PUCT formula
+const double MCTS_CPUCT = 1.5;
+// Unvisited children start this far below their parent's value
+const double MCTS_FPU_REDUCTION = 0.2;
+// Visits a thread on its way down counts as lost, so other threads spread out
+const int MCTS_VIRTUAL_LOSS = 3;
+// Centipawns to a value in (-1, 1) through tanh(cp / scale)
+const double MCTS_EVAL_SCALE = 400.0;
+// Softmax temperature in centipawns for the move priors
+const double MCTS_PRIOR_TEMPERATURE = 200.0;
+// Values are summed as fixed point integers so they can be atomics
+const double MCTS_VALUE_UNIT = 10000.0;
+// Edges reserved per node when sizing the pools
+const size_t MCTS_EDGES_PER_NODE = 16;
+// Memory for both pools if resize() was never called
+const size_t MCTS_DEFAULT_SIZE_MB = 256;
+// Index 0 is never handed out and stands for "no node"
+const uint32_t MCTS_NO_NODE = 0;
+
+enum MctsState : uint8_t {
+    MCTS_NEW,          // never visited
+    MCTS_LEAF,         // evaluated once, children not created yet
+    MCTS_EXPANDING,    // a thread is creating the edges
+    MCTS_EXPANDED,
+    MCTS_TERMINAL_LOSS, // the side to move is mated
+    MCTS_TERMINAL_DRAW
+};
+
+struct MctsEdge {
+    chess::Move move;
+    float prior = 0;
+    std::atomic<uint32_t> child{MCTS_NO_NODE};
+};
+
+// Value is summed from the point of view of the side that moved into the node,
+// which is what its parent maximises
+struct MctsNode {
+    std::atomic<uint32_t> visits{0};
+    std::atomic<int32_t> virtualLoss{0};
+    std::atomic<int64_t> valueSum{0};
+    uint32_t firstEdge = 0;
+    uint16_t edgeCount = 0;
+    std::atomic<uint8_t> state{MCTS_NEW};
+};
+
+// Bump allocator for nodes and edges. Nothing is freed on its own: the tree
+// kept between moves is copied into the other pool and this one is reset.
+class MctsPool {
+public:
+    void resize(size_t nodeCapacity);
+    void clear();
+    uint32_t allocNode();
+    uint32_t allocEdges(uint32_t count);
+
+    MctsNode &node(uint32_t index) { return nodes[index]; }
+    MctsEdge &edge(uint32_t index) { return edges[index]; }
+    size_t size() const { return std::min<size_t>(nodeCount, nodeCapacity); }
+
+private:
+    std::unique_ptr<MctsNode[]> nodes;
+    std::unique_ptr<MctsEdge[]> edges;
+    size_t nodeCapacity = 0;
+    size_t edgeCapacity = 0;
+    std::atomic<size_t> nodeCount{1};
+    std::atomic<size_t> edgeCount{0};
+};
+
+// Monte Carlo tree search with PUCT selection and quiescence search leaf values.
+// Threads share one tree (tree parallelism) and are kept apart by virtual loss.
+// The subtree of the position reached after the engine's and the opponent's
+// moves is kept for the next search.
+class MctsSearch {
+public:
+    void resize(size_t megabytes);
+    // Only the node and time limits apply, the tree has no depth to limit
+    chess::Move search(const chess::Board &board, const SearchLimits &limits);
+
+    uint64_t playouts() const { return playoutCount; }
+    size_t treeSize() const { return pools[current].size(); }
+
+private:
+    void worker(SearchThread &thread);
+    bool playout(SearchThread &thread);
+    double leafValue(SearchThread &thread, uint32_t index, bool isRoot);
+    bool expand(chess::Board &board, uint32_t index);
+    uint32_t selectEdge(uint32_t index);
+    void backup(const std::vector<uint32_t> &path, double value);
+
+    uint32_t findReusableRoot(const chess::Board &board);
+    uint32_t copySubtree(uint32_t from);
+
+    MctsPool pools[2];
+    int current = 0;
+    uint32_t root = MCTS_NO_NODE;
+    chess::Board rootBoard;
+    std::atomic<bool> poolFull{false};
+    std::atomic<uint64_t> playoutCount{0};
+};
+
+MctsSearch mcts;
+
+double nodeValue(MctsNode &node);
+
+void MctsPool::resize(size_t nodeCapacity) {
+    this->nodeCapacity = nodeCapacity;
+    edgeCapacity = nodeCapacity * MCTS_EDGES_PER_NODE;
+    nodes.reset(new MctsNode[nodeCapacity]);
+    edges.reset(new MctsEdge[edgeCapacity]);
+    clear();
+}
+
+void MctsPool::clear() {
+    nodeCount = 1;
+    edgeCount = 0;
+}
+
+// Returns MCTS_NO_NODE when the pool is full
+uint32_t MctsPool::allocNode() {
+    const size_t index = nodeCount.fetch_add(1);
+    if (index >= nodeCapacity) {
+        return MCTS_NO_NODE;
+    }
+
+    MctsNode &node = nodes[index];
+    node.visits.store(0, std::memory_order_relaxed);
+    node.virtualLoss.store(0, std::memory_order_relaxed);
+    node.valueSum.store(0, std::memory_order_relaxed);
+    node.firstEdge = 0;
+    node.edgeCount = 0;
+    node.state.store(MCTS_NEW, std::memory_order_relaxed);
+    return (uint32_t)index;
+}
+
+// Returns the first of count consecutive edges, or UINT32_MAX when the pool is full
+uint32_t MctsPool::allocEdges(uint32_t count) {
+    const size_t first = edgeCount.fetch_add(count);
+    if (first + count > edgeCapacity) {
+        return UINT32_MAX;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        edges[first + i].child.store(MCTS_NO_NODE, std::memory_order_relaxed);
+    }
+    return (uint32_t)first;
+}
+
+void MctsSearch::resize(size_t megabytes) {
+    const size_t perNode = sizeof(MctsNode) + MCTS_EDGES_PER_NODE * sizeof(MctsEdge);
+    const size_t capacity = std::max<size_t>((megabytes * 1024 * 1024) / (2 * perNode), 2);
+
+    pools[0].resize(capacity);
+    pools[1].resize(capacity);
+    root = MCTS_NO_NODE;
+}
+
+chess::Move MctsSearch::search(const chess::Board &board, const SearchLimits &limits) {
+    if (pools[current].size() == 0) {
+        resize(MCTS_DEFAULT_SIZE_MB);
+    }
+
+    prepareSearch(board, limits);
+    poolFull = false;
+
+    // Playouts have no iterations to stop between, so with a clock the soft limit is the budget
+    if (timeManager.softLimitMs()) {
+        searchInfo.timeLimitMs = timeManager.softLimitMs();
+    }
+    playoutCount = 0;
+
+    // Keep what is known about this position, whatever else is in the tree goes
+    const uint32_t reused = findReusableRoot(board);
+    if (reused != MCTS_NO_NODE) {
+        root = copySubtree(reused);
+    } else {
+        pools[current].clear();
+        root = pools[current].allocNode();
+    }
+    rootBoard = board;
+
+    // The root is expanded up front so every thread starts with a choice to make
+    chess::Board &mainBoard = searchThreads[0]->board;
+    MctsNode &rootNode = pools[current].node(root);
+    if (rootNode.state.load() != MCTS_EXPANDED && !expand(mainBoard, root)) {
+        return chess::Move::NO_MOVE;
+    }
+
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < searchThreads.size(); i++) {
+        helpers.emplace_back(&MctsSearch::worker, this, std::ref(*searchThreads[i]));
+    }
+    worker(*searchThreads[0]);
+
+    searchInfo.stopped = true;
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+
+    for (auto &thread : searchThreads) {
+        searchInfo.nodes += thread->nodes - thread->flushedNodes;
+        thread->flushedNodes = thread->nodes;
+    }
+    searchInfo.elapsedMs = elapsedMs();
+
+    // The most visited move is the one the search trusts most
+    MctsPool &pool = pools[current];
+    chess::Move bestMove = pool.edge(rootNode.firstEdge).move;
+    uint32_t bestVisits = 0;
+    for (uint32_t i = 0; i < rootNode.edgeCount; i++) {
+        const MctsEdge &edge = pool.edge(rootNode.firstEdge + i);
+        const uint32_t child = edge.child.load();
+        const uint32_t visits = child == MCTS_NO_NODE ? 0 : pool.node(child).visits.load();
+        if (visits > bestVisits) {
+            bestVisits = visits;
+            bestMove = edge.move;
+        }
+    }
+
+    return bestMove;
+}
+
+void MctsSearch::worker(SearchThread &thread) {
+    // Playouts that end in a finished game never reach quiescence, so count each
+    // playout as a node too or such a tree would never look at the clock. A full
+    // pool doesn't end the search, the playouts then stop where the tree ends.
+    while (!checkLimits(thread)) {
+        if (!playout(thread)) {
+            break;
+        }
+        playoutCount++;
+    }
+}
+
+// Walks down from the root by PUCT, evaluates where the tree ends and backs the
+// value up. Returns false if the search was stopped before the value was known.
+bool MctsSearch::playout(SearchThread &thread) {
+    MctsPool &pool = pools[current];
+    chess::Board &board = thread.board;
+    std::vector<chess::Move> moves;
+    std::vector<uint32_t> path{root};
+    pool.node(root).virtualLoss += MCTS_VIRTUAL_LOSS;
+
+    double value;
+    while (true) {
+        const uint32_t index = path.back();
+        MctsNode &node = pool.node(index);
+        const uint8_t state = node.state.load(std::memory_order_acquire);
+
+        // A leaf seen before gets its children now, unless another thread is on it
+        // or there is no room left for them
+        if (state == MCTS_LEAF) {
+            uint8_t expected = MCTS_LEAF;
+            if (poolFull || !node.state.compare_exchange_strong(expected, MCTS_EXPANDING) || !expand(board, index)) {
+                value = leafValue(thread, index, path.size() == 1);
+                break;
+            }
+        } else if (state != MCTS_EXPANDED) {
+            value = leafValue(thread, index, path.size() == 1);
+            break;
+        }
+
+        MctsEdge &edge = pool.edge(selectEdge(index));
+        uint32_t child = edge.child.load(std::memory_order_acquire);
+        if (child == MCTS_NO_NODE) {
+            const uint32_t created = poolFull ? MCTS_NO_NODE : pool.allocNode();
+            if (created == MCTS_NO_NODE) {
+                poolFull = true;
+                value = leafValue(thread, index, path.size() == 1);
+                break;
+            }
+
+            // Another thread may have created the child first, then this node is wasted
+            child = edge.child.compare_exchange_strong(child, created) ? created : child;
+        }
+
+        board.makeMove(edge.move);
+        moves.push_back(edge.move);
+        path.push_back(child);
+        pool.node(child).virtualLoss += MCTS_VIRTUAL_LOSS;
+    }
+
+    for (auto it = moves.rbegin(); it != moves.rend(); ++it) {
+        board.unmakeMove(*it);
+    }
+
+    if (searchInfo.stopped) {
+        for (uint32_t index : path) {
+            pool.node(index).virtualLoss -= MCTS_VIRTUAL_LOSS;
+        }
+        return false;
+    }
+
+    backup(path, value);
+    return true;
+}
+
+// Value of the position for its side to move. The first visit settles whether
+// the game is over here, after that it is a quiescence search.
+double MctsSearch::leafValue(SearchThread &thread, uint32_t index, bool isRoot) {
+    MctsNode &node = pools[current].node(index);
+    chess::Board &board = thread.board;
+
+    uint8_t state = node.state.load(std::memory_order_acquire);
+    if (state == MCTS_NEW) {
+        chess::Movelist legal;
+        chess::movegen::legalmoves(legal, board);
+
+        if (legal.empty()) {
+            state = board.inCheck() ? MCTS_TERMINAL_LOSS : MCTS_TERMINAL_DRAW;
+        } else if (!isRoot && (board.isRepetition(1) || board.isHalfMoveDraw() || board.isInsufficientMaterial())) {
+            state = MCTS_TERMINAL_DRAW;
+        } else {
+            state = MCTS_LEAF;
+        }
+
+        uint8_t expected = MCTS_NEW;
+        node.state.compare_exchange_strong(expected, state, std::memory_order_release);
+    }
+
+    if (state == MCTS_TERMINAL_LOSS) {
+        return -1.0;
+    }
+    if (state == MCTS_TERMINAL_DRAW) {
+        return 0.0;
+    }
+
+    return std::tanh(quiescence(thread, 0, -VALUE_INFINITE, VALUE_INFINITE) / MCTS_EVAL_SCALE);
+}
+
+// Creates the edges of a node with priors from a softmax over captures and
+// promotions by MVV-LVA, quiet moves sharing what is left
+bool MctsSearch::expand(chess::Board &board, uint32_t index) {
+    MctsPool &pool = pools[current];
+    MctsNode &node = pool.node(index);
+
+    chess::Movelist legal;
+    chess::movegen::legalmoves(legal, board);
+
+    const uint32_t first = legal.empty() ? UINT32_MAX : pool.allocEdges(legal.size());
+    if (first == UINT32_MAX) {
+        if (!legal.empty()) {
+            poolFull = true;
+        }
+        node.state.store(MCTS_LEAF, std::memory_order_release);
+        return false;
+    }
+
+    double total = 0;
+    std::vector<double> weights(legal.size());
+    for (int i = 0; i < legal.size(); i++) {
+        const chess::Move move = legal[i];
+        const bool tactical = board.isCapture(move) || move.typeOf() == chess::Move::PROMOTION;
+        weights[i] = std::exp((tactical ? mvvLva(board, move) : 0) / MCTS_PRIOR_TEMPERATURE);
+        total += weights[i];
+    }
+
+    for (int i = 0; i < legal.size(); i++) {
+        MctsEdge &edge = pool.edge(first + i);
+        edge.move = legal[i];
+        edge.prior = (float)(weights[i] / total);
+    }
+
+    node.firstEdge = first;
+    node.edgeCount = (uint16_t)legal.size();
+    node.state.store(MCTS_EXPANDED, std::memory_order_release);
+    return true;
+}
+
+// PUCT: value plus an exploration term that favours high prior, rarely visited moves
+uint32_t MctsSearch::selectEdge(uint32_t index) {
+    MctsPool &pool = pools[current];
+    MctsNode &node = pool.node(index);
+
+    const uint32_t visits = node.visits.load(std::memory_order_relaxed);
+    const double parentVisits = visits + node.virtualLoss.load(std::memory_order_relaxed);
+    const double exploration = MCTS_CPUCT * std::sqrt(std::max(parentVisits, 1.0));
+
+    // The node's own value is stored for the other side
+    const double parentValue = visits ? -node.valueSum.load(std::memory_order_relaxed) / MCTS_VALUE_UNIT / visits : 0.0;
+    const double firstPlayUrgency = parentValue - MCTS_FPU_REDUCTION;
+
+    uint32_t best = node.firstEdge;
+    double bestScore = -1e9;
+    for (uint32_t i = node.firstEdge; i < node.firstEdge + node.edgeCount; i++) {
+        MctsEdge &edge = pool.edge(i);
+        const uint32_t child = edge.child.load(std::memory_order_acquire);
+
+        double value = firstPlayUrgency;
+        double childVisits = 0;
+        if (child != MCTS_NO_NODE) {
+            MctsNode &childNode = pool.node(child);
+            childVisits = childNode.visits.load(std::memory_order_relaxed)
+                + childNode.virtualLoss.load(std::memory_order_relaxed);
+            if (childVisits > 0) {
+                value = nodeValue(childNode);
+            }
+        }
+
+        const double score = value + exploration * edge.prior / (1 + childVisits);
+        if (score > bestScore) {
+            bestScore = score;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+// value is for the side to move at the end of the path, each node takes it for
+// the side that moved into it
+void MctsSearch::backup(const std::vector<uint32_t> &path, double value) {
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        MctsNode &node = pools[current].node(*it);
+        value = -value;
+        node.valueSum += std::llround(value * MCTS_VALUE_UNIT);
+        node.visits++;
+        node.virtualLoss -= MCTS_VIRTUAL_LOSS;
+    }
+}
+
+// The last root or one of its children or grandchildren, if one of them is this position
+uint32_t MctsSearch::findReusableRoot(const chess::Board &board) {
+    if (root == MCTS_NO_NODE) {
+        return MCTS_NO_NODE;
+    }
+    if (rootBoard.hash() == board.hash()) {
+        return root;
+    }
+
+    MctsPool &pool = pools[current];
+    // Depth first over two plies, replaying the moves on a copy of the old root position
+    chess::Board position = rootBoard;
+    auto search = [&](auto &self, uint32_t index, int ply) -> uint32_t {
+        MctsNode &node = pool.node(index);
+        if (ply == 2 || node.state.load() != MCTS_EXPANDED) {
+            return MCTS_NO_NODE;
+        }
+
+        for (uint32_t i = node.firstEdge; i < node.firstEdge + node.edgeCount; i++) {
+            const MctsEdge &edge = pool.edge(i);
+            const uint32_t child = edge.child.load();
+            if (child == MCTS_NO_NODE) {
+                continue;
+            }
+
+            position.makeMove(edge.move);
+            uint32_t found = position.hash() == board.hash() ? child : self(self, child, ply + 1);
+            position.unmakeMove(edge.move);
+
+            if (found != MCTS_NO_NODE) {
+                return found;
+            }
+        }
+        return MCTS_NO_NODE;
+    };
+
+    return search(search, root, 0);
+}
+
+// Moves the subtree under from into the other pool, which becomes the current one
+uint32_t MctsSearch::copySubtree(uint32_t from) {
+    MctsPool &source = pools[current];
+    MctsPool &target = pools[1 - current];
+    target.clear();
+
+    const uint32_t newRoot = target.allocNode();
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{from, newRoot}};
+
+    while (!stack.empty()) {
+        const auto [oldIndex, newIndex] = stack.back();
+        stack.pop_back();
+
+        MctsNode &oldNode = source.node(oldIndex);
+        MctsNode &newNode = target.node(newIndex);
+        const uint8_t state = oldNode.state.load();
+
+        newNode.visits = oldNode.visits.load();
+        newNode.valueSum = oldNode.valueSum.load();
+        newNode.state = state == MCTS_EXPANDING ? static_cast<uint8_t>(MCTS_LEAF) : state;
+
+        if (state != MCTS_EXPANDED) {
+            continue;
+        }
+
+        newNode.firstEdge = target.allocEdges(oldNode.edgeCount);
+        newNode.edgeCount = oldNode.edgeCount;
+        for (uint32_t i = 0; i < oldNode.edgeCount; i++) {
+            const MctsEdge &oldEdge = source.edge(oldNode.firstEdge + i);
+            MctsEdge &newEdge = target.edge(newNode.firstEdge + i);
+            newEdge.move = oldEdge.move;
+            newEdge.prior = oldEdge.prior;
+
+            const uint32_t oldChild = oldEdge.child.load();
+            if (oldChild != MCTS_NO_NODE) {
+                const uint32_t newChild = target.allocNode();
+                newEdge.child = newChild;
+                stack.push_back({oldChild, newChild});
+            }
+        }
+    }
+
+    source.clear();
+    current = 1 - current;
+    return newRoot;
+}
+
+// Mean value with the virtual losses of threads still below this node counted in
+double nodeValue(MctsNode &node) {
+    const int32_t virtualLoss = node.virtualLoss.load(std::memory_order_relaxed);
+    const double visits = node.visits.load(std::memory_order_relaxed) + virtualLoss;
+    const double value = node.valueSum.load(std::memory_order_relaxed) / MCTS_VALUE_UNIT - virtualLoss;
+    return value / visits;
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include "libraries/chess.hpp"
+#include "values.hpp"
+#include "history.hpp"
+#include "see.hpp"
+#include <algorithm>
+
+const int MAX_PLY = 128;
+
+// Captures that don't lose material are scored above this, losing captures keep their raw MVV-LVA score
+const int GOOD_CAPTURE_BONUS = 10000;
+const int CAPTURE_HISTORY_DIVISOR = 32;
+const int QUEEN_PROMOTION_SCORE = 32000;
+
+enum class PickerStage {
+    TT_MOVE,
+    GEN_CAPTURES,
+    GOOD_CAPTURES,
+    REFUTATIONS,
+    GEN_QUIETS,
+    QUIETS,
+    BAD_CAPTURES,
+    DONE
+};
+
+int mvvLva(const chess::Board &board, chess::Move move);
+int quietHistoryScore(const chess::Board &board, const HistoryTables &history,
+                      PieceToHistory *const (&continuation)[2], chess::Move move);
+bool isLegal(const chess::Board &board, chess::Move move);
+bool hasCheckingMove(const chess::Board &board);
+
+// Yields moves one at a time in stages so that nodes which cut off early
+// never pay for generating or sorting the moves they don't need.
+// continuation holds the continuation history tables for the moves one and
+// two plies earlier, either may be null. The moves are generated into lists
+// the caller owns, so the picker itself stays small on the stack.
+class MovePicker {
+public:
+    MovePicker(const chess::Board &board, chess::Move ttMove, const chess::Move (&killers)[2], chess::Move counterMove,
+               const HistoryTables &history, PieceToHistory *const (&continuation)[2], chess::Movelist &captures,
+               chess::Movelist &quiets);
+
+    chess::Move next();
+
+    // Late move pruning: stop yielding killers and quiet moves
+    void skipQuiets();
+
+private:
+    bool isRefutation(chess::Move move) const;
+    chess::Move pickBest(chess::Movelist &list, int index);
+
+    const chess::Board &board;
+    const HistoryTables &history;
+    PieceToHistory *continuation[2];
+    chess::Move ttMove;
+    // Killers, then the counter move
+    chess::Move refutations[3];
+    PickerStage stage = PickerStage::TT_MOVE;
+    bool skipQuietMoves = false;
+
+    chess::Movelist &captures;
+    chess::Movelist &quiets;
+    int captureIndex = 0;
+    int badCaptureIndex = 0;
+    int quietIndex = 0;
+    int refutationIndex = 0;
+};
+
+MovePicker::MovePicker(const chess::Board &board, chess::Move ttMove, const chess::Move (&killers)[2],
+                       chess::Move counterMove, const HistoryTables &history,
+                       PieceToHistory *const (&continuation)[2], chess::Movelist &captures, chess::Movelist &quiets)
+    : board(board), history(history), continuation{continuation[0], continuation[1]}, ttMove(ttMove),
+      refutations{killers[0], killers[1], counterMove}, captures(captures), quiets(quiets) {
+    captures.clear();
+    quiets.clear();
+}
+
+chess::Move MovePicker::next() {
+    switch (stage) {
+        case PickerStage::TT_MOVE:
+            stage = PickerStage::GEN_CAPTURES;
+            if (ttMove != chess::Move::NO_MOVE && isLegal(board, ttMove)) {
+                return ttMove;
+            }
+            ttMove = chess::Move::NO_MOVE;
+            [[fallthrough]];
+
+        case PickerStage::GEN_CAPTURES:
+            chess::movegen::legalmoves<chess::movegen::MoveGenType::CAPTURE>(captures, board);
+            for (auto &move : captures) {
+                const chess::Piece piece = board.at(move.from());
+                int score = mvvLva(board, move)
+                    + history.captures[piece][move.to().index()][capturedType(board, move)] / CAPTURE_HISTORY_DIVISOR;
+                move.setScore(see(board, move, 0) ? score + GOOD_CAPTURE_BONUS : score);
+            }
+            stage = PickerStage::GOOD_CAPTURES;
+            [[fallthrough]];
+
+        case PickerStage::GOOD_CAPTURES:
+            while (captureIndex < captures.size()) {
+                chess::Move move = pickBest(captures, captureIndex);
+                if (move.score() < GOOD_CAPTURE_BONUS) {
+                    break;
+                }
+                captureIndex++;
+                if (move != ttMove) {
+                    return move;
+                }
+            }
+            badCaptureIndex = captureIndex;
+            stage = PickerStage::REFUTATIONS;
+            [[fallthrough]];
+
+        case PickerStage::REFUTATIONS:
+            while (!skipQuietMoves && refutationIndex < 3) {
+                const int index = refutationIndex++;
+                chess::Move move = refutations[index];
+                if (move == chess::Move::NO_MOVE || move == ttMove) {
+                    continue;
+                }
+                if (std::find(refutations, refutations + index, move) != refutations + index) {
+                    continue;
+                }
+                if (!board.isCapture(move) && isLegal(board, move)) {
+                    return move;
+                }
+            }
+            stage = PickerStage::GEN_QUIETS;
+            [[fallthrough]];
+
+        case PickerStage::GEN_QUIETS:
+            if (skipQuietMoves) {
+                stage = PickerStage::BAD_CAPTURES;
+                return next();
+            }
+            chess::movegen::legalmoves<chess::movegen::MoveGenType::QUIET>(quiets, board);
+            for (auto &move : quiets) {
+                if (move.typeOf() == chess::Move::PROMOTION && move.promotionType() == chess::PieceType::QUEEN) {
+                    move.setScore(QUEEN_PROMOTION_SCORE);
+                } else {
+                    move.setScore(quietHistoryScore(board, history, continuation, move) / 2);
+                }
+            }
+            stage = PickerStage::QUIETS;
+            [[fallthrough]];
+
+        case PickerStage::QUIETS:
+            while (!skipQuietMoves && quietIndex < quiets.size()) {
+                chess::Move move = pickBest(quiets, quietIndex++);
+                if (move != ttMove && !isRefutation(move)) {
+                    return move;
+                }
+            }
+            stage = PickerStage::BAD_CAPTURES;
+            [[fallthrough]];
+
+        case PickerStage::BAD_CAPTURES:
+            while (badCaptureIndex < captures.size()) {
+                chess::Move move = pickBest(captures, badCaptureIndex++);
+                if (move != ttMove) {
+                    return move;
+                }
+            }
+            stage = PickerStage::DONE;
+            [[fallthrough]];
+
+        case PickerStage::DONE:
+            break;
+    }
+
+    return chess::Move::NO_MOVE;
+}
+
+void MovePicker::skipQuiets() {
+    skipQuietMoves = true;
+}
+
+bool MovePicker::isRefutation(chess::Move move) const {
+    return move == refutations[0] || move == refutations[1] || move == refutations[2];
+}
+
+// Selection sort step: swap the best scored remaining move into place
+chess::Move MovePicker::pickBest(chess::Movelist &list, int index) {
+    int best = index;
+    for (int i = index + 1; i < list.size(); i++) {
+        if (list[i].score() > list[best].score()) {
+            best = i;
+        }
+    }
+
+    std::swap(list[index], list[best]);
+    return list[index];
+}
+
+// Most valuable victim first, least valuable attacker breaks ties
+int mvvLva(const chess::Board &board, chess::Move move) {
+    const chess::PieceType attacker = board.at<chess::PieceType>(move.from());
+    const chess::PieceType victim = move.typeOf() == chess::Move::ENPASSANT
+        ? chess::PieceType(chess::PieceType::PAWN)
+        : board.at<chess::PieceType>(move.to());
+
+    int score = pieceValues[victim] - (int)attacker;
+    if (move.typeOf() == chess::Move::PROMOTION) {
+        score += pieceValues[move.promotionType()];
+    }
+
+    return score;
+}
+
+// Butterfly plus both continuation histories, what quiet moves are ordered and reduced by
+int quietHistoryScore(const chess::Board &board, const HistoryTables &history,
+                      PieceToHistory *const (&continuation)[2], chess::Move move) {
+    const chess::Piece piece = board.at(move.from());
+    const int to = move.to().index();
+
+    int score = history.butterfly[(int)board.sideToMove()][move.from().index()][to];
+    for (PieceToHistory *table : continuation) {
+        if (table) {
+            score += (*table)[piece][to];
+        }
+    }
+
+    return score;
+}
+
+// Checks a move that did not come from this position's move generation (hash moves,
+// killers) by generating only the moves of the piece on its from square.
+bool isLegal(const chess::Board &board, chess::Move move) {
+    const chess::Piece piece = board.at(move.from());
+    if (piece == chess::Piece::NONE || piece.color() != board.sideToMove()) {
+        return false;
+    }
+
+    chess::Movelist moves;
+    chess::movegen::legalmoves(moves, board, 1 << (int)piece.type());
+
+    return std::find(moves.begin(), moves.end(), move) != moves.end();
+}
+
+// Whether the side to move has a move that gives check, without generating or
+// making moves: a piece that can reach a square attacking the enemy king, or a
+// piece standing between the king and one of our sliders. Pins are ignored and
+// castling checks are missed, so it is only a quick filter.
+bool hasCheckingMove(const chess::Board &board) {
+    using namespace chess;
+
+    const Color us = board.sideToMove();
+    const Square king = board.kingSq(~us);
+    const Bitboard occupied = board.occ();
+    const Bitboard targets = ~board.us(us);
+
+    // Squares each kind of piece would give check from
+    const Bitboard pawnChecks = attacks::pawn(~us, king) & targets;
+    const Bitboard knightChecks = attacks::knight(king) & targets;
+    const Bitboard diagonalChecks = attacks::bishop(king, occupied);
+    const Bitboard orthogonalChecks = attacks::rook(king, occupied);
+
+    const Bitboard pawns = board.pieces(PieceType::PAWN, us);
+    const Bitboard empty = ~occupied;
+    const Bitboard singlePushes = us == Color::WHITE ? Bitboard(pawns.getBits() << 8) & empty
+                                                     : Bitboard(pawns.getBits() >> 8) & empty;
+    const Bitboard doublePushes = us == Color::WHITE
+        ? Bitboard((singlePushes & attacks::MASK_RANK[2]).getBits() << 8) & empty
+        : Bitboard((singlePushes & attacks::MASK_RANK[5]).getBits() >> 8) & empty;
+    Bitboard pawnTargets = board.us(~us);
+    if (board.enpassantSq() != Square::underlying::NO_SQ) {
+        pawnTargets |= Bitboard::fromSquare(board.enpassantSq());
+    }
+
+    Bitboard pawnMoves = singlePushes | doublePushes;
+    Bitboard pieces = pawns;
+    while (pieces) {
+        pawnMoves |= attacks::pawn(us, pieces.pop()) & pawnTargets;
+    }
+
+    // A promotion checks as a knight or a queen from the last rank, maybe along
+    // the file the pawn leaves
+    const Bitboard promoting = pawns & attacks::MASK_RANK[us == Color::WHITE ? 6 : 1];
+    const Bitboard promotions = pawnMoves & attacks::MASK_RANK[us == Color::WHITE ? 7 : 0];
+    const Bitboard promotionChecks = knightChecks | attacks::queen(king, occupied ^ promoting);
+    if ((pawnMoves & pawnChecks) || (promotions & promotionChecks)) {
+        return true;
+    }
+
+    pieces = board.pieces(PieceType::KNIGHT, us);
+    while (pieces) {
+        if (attacks::knight(pieces.pop()) & knightChecks) {
+            return true;
+        }
+    }
+
+    const Bitboard queens = board.pieces(PieceType::QUEEN, us);
+    const Bitboard diagonals = board.pieces(PieceType::BISHOP, us) | queens;
+    const Bitboard orthogonals = board.pieces(PieceType::ROOK, us) | queens;
+
+    pieces = board.pieces(PieceType::BISHOP, us);
+    while (pieces) {
+        if (attacks::bishop(pieces.pop(), occupied) & diagonalChecks & targets) {
+            return true;
+        }
+    }
+
+    pieces = board.pieces(PieceType::ROOK, us);
+    while (pieces) {
+        if (attacks::rook(pieces.pop(), occupied) & orthogonalChecks & targets) {
+            return true;
+        }
+    }
+
+    pieces = queens;
+    while (pieces) {
+        if (attacks::queen(pieces.pop(), occupied) & (diagonalChecks | orthogonalChecks) & targets) {
+            return true;
+        }
+    }
+
+    // Discovered checks: one of our pieces is the only thing between a slider and the king
+    Bitboard blockers = (diagonalChecks | orthogonalChecks) & board.us(us);
+    while (blockers) {
+        const Bitboard without = occupied ^ Bitboard::fromSquare(blockers.pop());
+        if ((attacks::bishop(king, without) & diagonals) || (attacks::rook(king, without) & orthogonals)) {
+            return true;
+        }
+    }
+
+    return false;
+}
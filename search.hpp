@@ -1,73 +1,1316 @@
+#pragma once
+
 #include "libraries/chess.hpp"
-#include <climits>
+#include "tt.hpp"
+#include "values.hpp"
+#include "movepicker.hpp"
+#include "history.hpp"
+#include "timeman.hpp"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <array>
+#include <cmath>
+
+enum class NodeType {
+    Root,
+    PV,
+    NonPV
+};
+
+// How each iteration of the root search looks for the score
+enum class RootDriver {
+    Aspiration, // PVS inside an aspiration window around the previous score
+    MTDF        // MTD(f): null window searches converging on the score
+};
+
+struct RootMove {
+    chess::Move move;
+    int score = 0;
+    std::vector<chess::Move> pv = {};
+    // Nodes searched below this move over all iterations, for the time manager
+    uint64_t nodes = 0;
+};
+
+// State shared by all search threads, limits are written before the threads start
+struct SearchInfo {
+    std::chrono::steady_clock::time_point startTime;
+    SearchLimits limits;
+    int64_t timeLimitMs = 0; // hard limit from the time manager, 0 means no limit
+    std::atomic<uint64_t> nodes{0};
+    std::atomic<bool> stopped{false};
+    int completedDepth = 0;
+
+    // Set from outside a running search, so prepareSearch leaves them alone.
+    // While pondering there is no time limit, on a ponder hit the clock starts
+    // at ponderHitTicks. A stop request ends the search like a limit would.
+    std::atomic<bool> pondering{false};
+    std::atomic<int64_t> ponderHitTicks{0};
+    std::atomic<bool> stopRequested{false};
+
+    // Statistics of the last finished search, for comparing root drivers
+    int64_t elapsedMs = 0;
+    uint64_t rootSearches = 0;
+
+    // Number of best root moves searched with exact scores, and those lines
+    // with their principal variations once the search is done
+    int multiPV = 1;
+    std::vector<RootMove> lines;
+};
+
+// What the search knows about one ply of the current path. Entries are cache
+// line aligned so a node and its neighbours never split a line.
+struct alignas(64) StackEntry {
+    // Position key, for repetition detection
+    uint64_t key = 0;
 
-int minimax(chess::Board &board, int depth, int alpha, int beta, bool isMaxPlayer);
+    // Move made from this ply, the piece that made it and its continuation
+    // history table, which is null for null moves
+    chess::Move currentMove = chess::Move::NO_MOVE;
+    chess::Piece movedPiece = chess::Piece::NONE;
+    PieceToHistory *continuationHistory = nullptr;
+
+    // Move left out by a singular extension search, and the number of plies of
+    // extension spent on the path to this ply
+    chess::Move excludedMove = chess::Move::NO_MOVE;
+    int extensions = 0;
+
+    chess::Move killers[2];
+    // Corrected static eval, -VALUE_INFINITE in check
+    int staticEval = 0;
+
+    // Moves searched at this ply without a cutoff, they get a history malus
+    chess::Movelist quietsTried;
+    chess::Movelist capturesTried;
+
+    // Move generation buffers for the move picker, ProbCut and quiescence at this
+    // ply, indexed by moveBuffers(). A singular verification search runs on the
+    // same ply while the picker's moves are still in use, so it gets the second pair.
+    chess::Movelist captures[2];
+    chess::Movelist quiets[2];
+};
+
+// Everything a single search thread owns. Threads only talk to each other
+// through the transposition table and the stop flag.
+struct SearchThread {
+    int id = 0;
+    chess::Board board;
+    uint64_t nodes = 0;
+    uint64_t flushedNodes = 0;
+    int completedDepth = 0;
+    uint64_t rootSearches = 0;
+    chess::Move bestMove = chess::Move::NO_MOVE;
+    std::vector<RootMove> rootMoves;
+    std::vector<RootMove> bestLines;
+
+    // Multi-PV pass: root moves before this index already have their line and are skipped
+    int pvIndex = 0;
+
+    // Search state of every ply on the current path, allocated once with the thread
+    StackEntry stack[MAX_PLY];
+
+    // Triangular PV table: pvTable[ply] holds the best line found from ply on,
+    // pvLength[ply] moves long
+    chess::Move pvTable[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY];
+
+    // Move ordering memory
+    HistoryTables history;
+
+    // The shared table, or in the deterministic search a private one so no
+    // thread sees results that depend on how fast another one got to them
+    TranspositionTable *table = &tt;
+    std::unique_ptr<TranspositionTable> privateTable;
+};
+
+SearchInfo searchInfo;
+std::vector<std::unique_ptr<SearchThread>> searchThreads;
+
+void setThreadCount(int count);
+void prepareSearch(const chess::Board &board, const SearchLimits &limits);
+int maxSearchDepth(const SearchLimits &limits);
+bool mateLimitReached(int score);
+chess::Move iterativeDeepening(chess::Board &board, const SearchLimits &limits,
+                               RootDriver driver = RootDriver::Aspiration, int multiPV = 1);
+void searchRoot(SearchThread &thread, int maxDepth, RootDriver driver);
+chess::Move deterministicSearch(chess::Board &board, const SearchLimits &limits);
+int searchRootMove(SearchThread &thread, chess::Move move, int depth, int alpha, int beta);
+int aspirationSearch(SearchThread &thread, int depth, int score);
+int mtdf(SearchThread &thread, int depth, int guess);
+void extendPVFromTT(SearchThread &thread, std::vector<chess::Move> &pv, int maxLength);
+void updatePV(SearchThread &thread, int ply, chess::Move move);
+template <NodeType nodeType>
+int negamax(SearchThread &thread, int depth, int ply, int alpha, int beta, bool allowNull = true);
+void updateHistories(SearchThread &thread, chess::Move bestMove, int depth, int ply, const chess::Movelist &quietsTried,
+                     const chess::Movelist &capturesTried);
+void continuationTables(SearchThread &thread, int ply, PieceToHistory *(&tables)[2]);
+void setCurrentMove(SearchThread &thread, int ply, chess::Move move);
+void clearMoveOrdering(SearchThread &thread);
+int quiescence(SearchThread &thread, int ply, int alpha, int beta);
+int moveBuffers(const SearchThread &thread, int ply);
 int evaluate(chess::Board& board);
+bool checkLimits(SearchThread &thread);
+bool isDraw(SearchThread &thread, int ply);
+int scoreToTT(int score, int ply);
+int scoreFromTT(int score, int ply);
+bool shouldStop();
+int64_t elapsedMs();
+int64_t thinkingMs();
+void ponderHit();
+
+const int MAX_DEPTH = 64;
+const int VALUE_INFINITE = 32001;
+const int VALUE_MATE = 32000;
+const int VALUE_MATE_IN_MAX_PLY = VALUE_MATE - MAX_PLY;
+const int VALUE_DRAW = 0;
+
+// How many nodes are searched between clock reads
+const uint64_t CHECK_INTERVAL = 2048;
+
+// Size of each thread's own table in the deterministic search
+const int PRIVATE_HASH_SIZE_MB = 16;
+
+// Aspiration windows at the root
+const int ASPIRATION_MIN_DEPTH = 4;
+const int ASPIRATION_WINDOW = 25;
+const int ASPIRATION_MAX_DELTA = 1000;
+const int ASPIRATION_MAX_SCORE = 10000;
 
-// Values from: https://www.chessprogramming.org/Simplified_Evaluation_Function
-const int PAWN = 100;
-const int KNIGHT = 320;
-const int BISHOP = 330;
-const int ROOK = 500;
-const int QUEEN = 900;
-const int KING = 20000;
-
-const int materialValues[12] = {
-    PAWN,
-    KNIGHT,
-    BISHOP,
-    ROOK,
-    QUEEN,
-    KING,
-    -PAWN,
-    -KNIGHT,
-    -BISHOP,
-    -ROOK,
-    -QUEEN,
-    -KING
+// Null move pruning, the reduction grows with depth and with how far the static eval clears the bound
+const int NULL_MOVE_MIN_DEPTH = 3;
+const int NULL_MOVE_BASE_REDUCTION = 3;
+const int NULL_MOVE_DEPTH_DIVISOR = 4;
+const int NULL_MOVE_EVAL_DIVISOR = 200;
+const int NULL_MOVE_MAX_EVAL_REDUCTION = 3;
+const int NULL_MOVE_VERIFY_DEPTH = 10;
+
+// Late move reductions for quiet moves
+const int LMR_MIN_DEPTH = 3;
+const int LMR_MIN_MOVES = 3;
+const int LMR_HISTORY_THRESHOLD = HISTORY_MAX;
+
+// Extensions, capped per search path so forcing lines can't grow without bound
+const int MAX_EXTENSIONS = 16;
+const int SINGULAR_MIN_DEPTH = 6;
+const int SINGULAR_TT_DEPTH_MARGIN = 3;
+const int SINGULAR_MARGIN = 2;
+
+// Forward pruning near the leaves. Margins are in centipawns per ply of remaining
+// depth, razoring's per ply squared, and live in one struct so they can be tuned
+// without recompiling.
+struct SearchParams {
+    int reverseFutilityDepth = 6;
+    int reverseFutilityMargin = 80;
+    int razoringDepth = 2;
+    int razoringMargin = 300;
+    int futilityDepth = 4;
+    int futilityBase = 100;
+    int futilityMargin = 100;
+    int lateMovePruningDepth = 6;
+    int lateMovePruningBase = 3;
+    int probCutDepth = 5;
+    int probCutMargin = 200;
+    int probCutReduction = 4;
+    int deltaMargin = 200;
 };
 
-int minimax(chess::Board &board, int depth, int alpha, int beta, bool isMaxPlayer) {
+SearchParams searchParams;
+
+// Reduction in plies indexed by [depth][moveNumber]
+const auto reductions = [] {
+    std::array<std::array<int, 64>, 64> table{};
+    for (int depth = 1; depth < 64; depth++) {
+        for (int moveNumber = 1; moveNumber < 64; moveNumber++) {
+            table[depth][moveNumber] = (int)(0.75 + std::log(depth) * std::log(moveNumber) / 2.25);
+        }
+    }
+    return table;
+}();
+
+void setThreadCount(int count) {
+    searchThreads.clear();
+    for (int i = 0; i < std::max(count, 1); i++) {
+        searchThreads.push_back(std::make_unique<SearchThread>());
+        searchThreads.back()->id = i;
+        searchThreads.back()->history.clear();
+    }
+}
+
+// Resets the shared limits and counters and gives every thread its own copy of the board
+void prepareSearch(const chess::Board &board, const SearchLimits &limits) {
+    if (searchThreads.empty()) {
+        setThreadCount(1);
+    }
+
+    searchInfo.startTime = std::chrono::steady_clock::now();
+    searchInfo.limits = limits;
+    timeManager.start(limits, board.sideToMove());
+    searchInfo.timeLimitMs = timeManager.hardLimitMs();
+    searchInfo.nodes = 0;
+    searchInfo.stopped = false;
+    searchInfo.completedDepth = 0;
+    searchInfo.rootSearches = 0;
+    searchInfo.multiPV = 1;
+    searchInfo.lines.clear();
+
+    for (auto &thread : searchThreads) {
+        thread->board = board;
+        thread->nodes = 0;
+        thread->flushedNodes = 0;
+        thread->completedDepth = 0;
+        thread->rootSearches = 0;
+        thread->bestMove = chess::Move::NO_MOVE;
+        thread->bestLines.clear();
+        thread->pvIndex = 0;
+        clearMoveOrdering(*thread);
+    }
+}
+
+int maxSearchDepth(const SearchLimits &limits) {
+    return limits.depth > 0 ? std::min(limits.depth, MAX_DEPTH) : MAX_DEPTH;
+}
+
+// Whether the score is a mate for the side to move short enough for the mate limit
+bool mateLimitReached(int score) {
+    const int mate = searchInfo.limits.mate;
+    return mate > 0 && score >= VALUE_MATE_IN_MAX_PLY && (VALUE_MATE - score + 1) / 2 <= mate;
+}
+
+// Lazy SMP: every thread runs its own iterative deepening on a private copy of
+// the board, helpers at staggered depths, and the deepest completed result wins.
+chess::Move iterativeDeepening(chess::Board &board, const SearchLimits &limits, RootDriver driver, int multiPV) {
+    prepareSearch(board, limits);
+    searchInfo.multiPV = std::max(multiPV, 1);
+    const int maxDepth = maxSearchDepth(limits);
+
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < searchThreads.size(); i++) {
+        helpers.emplace_back(searchRoot, std::ref(*searchThreads[i]), maxDepth, driver);
+    }
+
+    SearchThread &mainThread = *searchThreads[0];
+    searchRoot(mainThread, maxDepth, driver);
+
+    // Helpers keep going until told otherwise
+    searchInfo.stopped = true;
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+
+    SearchThread *best = &mainThread;
+    for (auto &thread : searchThreads) {
+        searchInfo.nodes += thread->nodes - thread->flushedNodes;
+        searchInfo.rootSearches += thread->rootSearches;
+        if (thread->bestMove != chess::Move::NO_MOVE && thread->completedDepth > best->completedDepth) {
+            best = thread.get();
+        }
+    }
+
+    searchInfo.completedDepth = best->completedDepth;
+    searchInfo.lines = best->bestLines;
+    searchInfo.elapsedMs = elapsedMs();
+    return best->bestMove;
+}
+
+void searchRoot(SearchThread &thread, int maxDepth, RootDriver driver) {
+    chess::Board &board = thread.board;
+
     chess::Movelist moves;
     chess::movegen::legalmoves(moves, board);
 
+    if (moves.empty()) {
+        return;
+    }
+
+    // Root moves in the order and with the scores of the last completed iteration
+    std::vector<RootMove> rootMoves;
+    for (int i = 0; i < moves.size(); i++) {
+        rootMoves.push_back({moves[i], 0});
+    }
+
+    thread.bestMove = rootMoves[0].move;
+    int score = 0;
+
+    // Odd helpers start one ply deeper so the threads don't all search the same depth
+    const int startDepth = 1 + (thread.id % 2);
+
+    thread.stack[0].excludedMove = chess::Move::NO_MOVE;
+    thread.stack[0].extensions = 0;
+
+    const int lineCount = std::min(searchInfo.multiPV, (int)rootMoves.size());
+
+    for (int depth = startDepth; depth <= maxDepth; depth++) {
+        thread.rootMoves = rootMoves;
+
+        // One pass per line, each leaving out the moves of the lines found before it
+        for (thread.pvIndex = 0; thread.pvIndex < lineCount; thread.pvIndex++) {
+            const int guess = thread.pvIndex == 0 ? score : rootMoves[thread.pvIndex].score;
+            const int value = driver == RootDriver::MTDF ? mtdf(thread, depth, guess) : aspirationSearch(thread, depth, guess);
+
+            if (searchInfo.stopped) {
+                break;
+            }
+            if (thread.pvIndex == 0) {
+                score = value;
+            }
+        }
+
+        // Results of an interrupted iteration are incomplete, keep the previous one
+        if (searchInfo.stopped) {
+            break;
+        }
+
+        // A later pass can come out above an earlier one, the lines are shown best first
+        std::stable_sort(thread.rootMoves.begin(), thread.rootMoves.begin() + lineCount,
+                         [](const RootMove &a, const RootMove &b) { return a.score > b.score; });
+
+        rootMoves = thread.rootMoves;
+        thread.bestMove = rootMoves[0].move;
+        thread.completedDepth = depth;
+
+        thread.bestLines.assign(rootMoves.begin(), rootMoves.begin() + lineCount);
+
+        // A mate found within the full search depth can't get any shorter, though
+        // the other lines of a multi-PV search still can
+        if (lineCount == 1 && std::abs(score) >= VALUE_MATE_IN_MAX_PLY && VALUE_MATE - std::abs(score) <= depth) {
+            break;
+        }
+
+        if (mateLimitReached(score)) {
+            searchInfo.stopped = true;
+            break;
+        }
+
+        // Only the main thread decides whether another iteration is worth its time
+        if (thread.id == 0 && thread.nodes > 0
+            && timeManager.stopAfterIteration(depth, thread.bestMove, score,
+                                              (double)rootMoves[0].nodes / thread.nodes, thinkingMs())
+            && !searchInfo.pondering) {
+            break;
+        }
+
+        if (shouldStop()) {
+            break;
+        }
+    }
+}
+
+// Deterministic parallel search, Young Brothers Wait split at the root: the
+// first move is searched alone, then the rest are shared out to the threads in
+// a fixed order and tested with a null window against its score, and the ones
+// that beat it are searched again on the main thread, in move order.
+// Every thread starts from cleared tables of its own and every window is known
+// before the threads start, so for a given thread count the best move, score
+// and node count of each depth never vary. The node limit is only checked
+// between iterations. A time limit still cuts an iteration short, whose result
+// is then dropped like in the normal search.
+chess::Move deterministicSearch(chess::Board &board, const SearchLimits &limits) {
+    SearchLimits sharedLimits = limits;
+    sharedLimits.nodes = 0;
+    prepareSearch(board, sharedLimits);
+    const int maxDepth = maxSearchDepth(limits);
+
+    for (auto &thread : searchThreads) {
+        if (!thread->privateTable) {
+            thread->privateTable = std::make_unique<TranspositionTable>();
+            thread->privateTable->resize(PRIVATE_HASH_SIZE_MB);
+        }
+        thread->privateTable->clear();
+        thread->table = thread->privateTable.get();
+        thread->history.clear();
+    }
+
+    chess::Movelist moves;
+    chess::movegen::legalmoves(moves, board);
+
+    std::vector<RootMove> rootMoves;
+    for (const auto &move : moves) {
+        rootMoves.push_back({move, -VALUE_INFINITE});
+    }
+
+    SearchThread &mainThread = *searchThreads[0];
+    const int threadCount = (int)searchThreads.size();
+    chess::Move bestMove = rootMoves.empty() ? chess::Move::NO_MOVE : rootMoves[0].move;
+    uint64_t completedNodes = 0;
+
+    for (int depth = 1; depth <= maxDepth && !rootMoves.empty(); depth++) {
+        // The eldest brother sets the bound the others are tested against
+        uint64_t nodesBefore = mainThread.nodes;
+        int alpha = searchRootMove(mainThread, rootMoves[0].move, depth, -VALUE_INFINITE, VALUE_INFINITE);
+        rootMoves[0].score = alpha;
+        rootMoves[0].nodes += mainThread.nodes - nodesBefore;
+
+        // Thread t takes moves t + 1, t + 1 + threadCount, ...
+        auto searchShare = [&](int t) {
+            SearchThread &thread = *searchThreads[t];
+            for (size_t i = t + 1; i < rootMoves.size() && !searchInfo.stopped; i += threadCount) {
+                const uint64_t nodesBefore = thread.nodes;
+                rootMoves[i].score = searchRootMove(thread, rootMoves[i].move, depth, alpha, alpha + 1);
+                rootMoves[i].nodes += thread.nodes - nodesBefore;
+            }
+        };
+
+        if (!searchInfo.stopped) {
+            std::vector<std::thread> helpers;
+            for (int t = 1; t < threadCount; t++) {
+                helpers.emplace_back(searchShare, t);
+            }
+            searchShare(0);
+            for (auto &helper : helpers) {
+                helper.join();
+            }
+        }
+
+        for (size_t i = 1; i < rootMoves.size() && !searchInfo.stopped; i++) {
+            if (rootMoves[i].score > alpha) {
+                nodesBefore = mainThread.nodes;
+                rootMoves[i].score = searchRootMove(mainThread, rootMoves[i].move, depth, alpha, VALUE_INFINITE);
+                rootMoves[i].nodes += mainThread.nodes - nodesBefore;
+                alpha = std::max(alpha, rootMoves[i].score);
+            }
+        }
+
+        if (searchInfo.stopped) {
+            break;
+        }
+
+        std::stable_sort(rootMoves.begin(), rootMoves.end(), [](const RootMove &a, const RootMove &b) {
+            return a.score > b.score;
+        });
+
+        bestMove = rootMoves[0].move;
+        searchInfo.completedDepth = depth;
+        completedNodes = 0;
+        for (auto &thread : searchThreads) {
+            completedNodes += thread->nodes;
+        }
+
+        if (std::abs(alpha) >= VALUE_MATE_IN_MAX_PLY && VALUE_MATE - std::abs(alpha) <= depth) {
+            break;
+        }
+        const double bestMoveNodes = (double)rootMoves[0].nodes / std::max<uint64_t>(completedNodes, 1);
+        if ((limits.nodes && completedNodes >= limits.nodes) || mateLimitReached(alpha)
+            || (timeManager.stopAfterIteration(depth, bestMove, alpha, bestMoveNodes, thinkingMs()) && !searchInfo.pondering)
+            || shouldStop()) {
+            break;
+        }
+    }
+
+    for (auto &thread : searchThreads) {
+        thread->table = &tt;
+        searchInfo.rootSearches += thread->rootSearches;
+    }
+
+    searchInfo.nodes = completedNodes;
+    searchInfo.elapsedMs = elapsedMs();
+    return bestMove;
+}
+
+// Searches a single root move the way negamax<NodeType::Root> would, a null
+// window as a non-PV node and anything wider as a PV node. The root's entry on
+// the stack is filled in as negamax would, its children read it.
+int searchRootMove(SearchThread &thread, chess::Move move, int depth, int alpha, int beta) {
+    chess::Board &board = thread.board;
+
+    thread.stack[0].key = board.hash();
+    thread.stack[0].excludedMove = chess::Move::NO_MOVE;
+    thread.stack[0].extensions = 0;
+    thread.stack[0].staticEval = board.inCheck() ? -VALUE_INFINITE
+        : std::clamp(correctedEval(thread.history, board, evaluate(board)), -VALUE_MATE_IN_MAX_PLY + 1, VALUE_MATE_IN_MAX_PLY - 1);
+    setCurrentMove(thread, 0, move);
+    thread.rootSearches++;
+
+    board.makeMove(move);
+
+    const int extension = board.inCheck() ? 1 : 0;
+    thread.stack[1].excludedMove = chess::Move::NO_MOVE;
+    thread.stack[1].extensions = extension;
+
+    const int value = beta - alpha == 1
+        ? -negamax<NodeType::NonPV>(thread, depth - 1 + extension, 1, -beta, -alpha)
+        : -negamax<NodeType::PV>(thread, depth - 1 + extension, 1, -beta, -alpha);
+
+    board.unmakeMove(move);
+    return value;
+}
+
+// Aspiration window around the previous score, widened exponentially on failure
+int aspirationSearch(SearchThread &thread, int depth, int score) {
+    int delta = ASPIRATION_WINDOW;
+    int alpha = -VALUE_INFINITE;
+    int beta = VALUE_INFINITE;
+    if (depth >= ASPIRATION_MIN_DEPTH && std::abs(score) < ASPIRATION_MAX_SCORE) {
+        alpha = score - delta;
+        beta = score + delta;
+    }
+
+    while (true) {
+        const int value = negamax<NodeType::Root>(thread, depth, 0, alpha, beta);
+        thread.rootSearches++;
+
+        if (searchInfo.stopped) {
+            return 0;
+        }
+
+        if (value <= alpha && alpha != -VALUE_INFINITE) {
+            delta *= 2;
+            alpha = delta > ASPIRATION_MAX_DELTA ? -VALUE_INFINITE : alpha - delta;
+        } else if (value >= beta && beta != VALUE_INFINITE) {
+            delta *= 2;
+            beta = delta > ASPIRATION_MAX_DELTA ? VALUE_INFINITE : beta + delta;
+        } else {
+            return value;
+        }
+    }
+}
+
+// MTD(f): null window searches around a guess, each one a bound that moves the
+// guess, until the bounds meet. Re-searching the same tree relies on the
+// transposition table. Only a search that failed high proves its best move, so
+// the root moves of the last one are what the iteration returns. Null windows
+// leave no principal variation behind, the best move's line is read back from
+// the transposition table instead.
+int mtdf(SearchThread &thread, int depth, int guess) {
+    int lower = -VALUE_INFINITE;
+    int upper = VALUE_INFINITE;
+    int value = guess;
+    std::vector<RootMove> failHighMoves;
+
+    while (lower < upper) {
+        const int beta = std::max(value, lower + 1);
+
+        // Moves cut off before being searched must not keep an older, higher score
+        for (size_t i = thread.pvIndex; i < thread.rootMoves.size(); i++) {
+            thread.rootMoves[i].score = -VALUE_INFINITE;
+        }
+
+        value = negamax<NodeType::Root>(thread, depth, 0, beta - 1, beta);
+        thread.rootSearches++;
+
+        if (searchInfo.stopped) {
+            return 0;
+        }
+
+        if (value < beta) {
+            upper = value;
+        } else {
+            lower = value;
+            failHighMoves = thread.rootMoves;
+        }
+    }
+
+    if (!failHighMoves.empty()) {
+        thread.rootMoves = failHighMoves;
+        extendPVFromTT(thread, thread.rootMoves[thread.pvIndex].pv, depth);
+    }
+
+    return value;
+}
+
+// Follows the stored best moves from the end of pv, as long as they are legal
+// and don't repeat a position
+void extendPVFromTT(SearchThread &thread, std::vector<chess::Move> &pv, int maxLength) {
+    chess::Board &board = thread.board;
+    for (const auto &move : pv) {
+        board.makeMove(move);
+    }
+
+    chess::Movelist moves;
+    TTEntry entry;
+    while ((int)pv.size() < maxLength && thread.table->probe(board.hash(), entry)) {
+        const chess::Move move = entry.move;
+        chess::movegen::legalmoves(moves, board);
+        if (std::find(moves.begin(), moves.end(), move) == moves.end()) {
+            break;
+        }
+
+        board.makeMove(move);
+        pv.push_back(move);
+        if (board.isRepetition(1) || board.isHalfMoveDraw()) {
+            break;
+        }
+    }
+
+    for (auto it = pv.rbegin(); it != pv.rend(); ++it) {
+        board.unmakeMove(*it);
+    }
+}
+
+// Counts a node and, every CHECK_INTERVAL nodes, publishes the count and reads the clock
+bool checkLimits(SearchThread &thread) {
+    thread.nodes++;
+    if (thread.nodes - thread.flushedNodes >= CHECK_INTERVAL) {
+        searchInfo.nodes += thread.nodes - thread.flushedNodes;
+        thread.flushedNodes = thread.nodes;
+        return shouldStop();
+    }
+
+    return searchInfo.stopped.load(std::memory_order_relaxed);
+}
+
+bool shouldStop() {
+    if (searchInfo.stopRequested) {
+        searchInfo.stopped = true;
+    }
+
+    if (searchInfo.limits.nodes && searchInfo.nodes >= searchInfo.limits.nodes) {
+        searchInfo.stopped = true;
+    }
+
+    if (searchInfo.timeLimitMs && !searchInfo.pondering && thinkingMs() >= searchInfo.timeLimitMs) {
+        searchInfo.stopped = true;
+    }
+
+    return searchInfo.stopped;
+}
+
+int64_t elapsedMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - searchInfo.startTime).count();
+}
+
+// Time on the clock: since the start of the search, or since the ponder hit if
+// the search began while pondering
+int64_t thinkingMs() {
+    const std::chrono::steady_clock::time_point hit{std::chrono::steady_clock::duration(searchInfo.ponderHitTicks)};
+    const auto start = std::max(searchInfo.startTime, hit);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The opponent played the move being pondered on: from now on the search runs
+// on the engine's clock. The hit time is published before pondering ends.
+void ponderHit() {
+    searchInfo.ponderHitTicks = std::chrono::steady_clock::now().time_since_epoch().count();
+    searchInfo.pondering = false;
+}
+
+// Scores are relative to the side to move. The node type is known at compile
+// time, so the PV bookkeeping and the pruning that is only sound outside the PV
+// compile away where they don't apply.
+template <NodeType nodeType>
+int negamax(SearchThread &thread, int depth, int ply, int alpha, int beta, bool allowNull) {
+    constexpr bool isRoot = nodeType == NodeType::Root;
+    constexpr bool isPV = nodeType != NodeType::NonPV;
+
+    chess::Board &board = thread.board;
+    const uint64_t key = board.hash();
+    thread.stack[ply].key = key;
+    thread.pvLength[ply] = 0;
+
+    if constexpr (!isRoot) {
+        if (isDraw(thread, ply)) {
+            return VALUE_DRAW;
+        }
+
+        // Mate distance pruning: no line from here can beat a mate already found closer to the root
+        alpha = std::max(alpha, -VALUE_MATE + ply);
+        beta = std::min(beta, VALUE_MATE - ply - 1);
+        if (alpha >= beta) {
+            return alpha;
+        }
+    }
+
     if (depth <= 0) {
+        return quiescence(thread, ply, alpha, beta);
+    }
+
+    if (checkLimits(thread)) {
+        return 0;
+    }
+
+    if (ply >= MAX_PLY - 1) {
         return evaluate(board);
     }
 
-    int bestValue;
-    if (isMaxPlayer) {
-        bestValue = INT_MIN;
-        for (int i = 0; i < moves.size(); i++) {
-            const auto move = moves[i];
-            board.makeMove(move);
-            int value = minimax(board, depth - 1, alpha, beta, false);
-            board.unmakeMove(move);
-            bestValue = std::max(bestValue, value);
-            alpha = std::max(alpha, bestValue);
+    const int alphaOrig = alpha;
+    const chess::Move excludedMove = thread.stack[ply].excludedMove;
+    chess::Move ttMove = chess::Move::NO_MOVE;
+    int ttScore = 0;
 
-            if (beta <= alpha) {
-                break;
+    // A singular extension search shares the key of its node, so it must neither
+    // take cutoffs from nor overwrite the real entry
+    TTEntry entry;
+    const bool ttHit = excludedMove == chess::Move::NO_MOVE && thread.table->probe(key, entry);
+    if (ttHit) {
+        ttMove = entry.move;
+        ttScore = scoreFromTT(entry.score, ply);
+
+        if (!isPV && entry.depth >= depth) {
+            if (entry.bound == BOUND_EXACT) {
+                return ttScore;
+            }
+            if (entry.bound == BOUND_LOWER && ttScore >= beta) {
+                return ttScore;
+            }
+            if (entry.bound == BOUND_UPPER && ttScore <= alpha) {
+                return ttScore;
+            }
+        }
+    }
+
+    const bool inCheck = board.inCheck();
+    // Pruning works from the static eval corrected by how far off it has been in
+    // this pawn structure, kept clear of the mate range
+    const int rawEval = inCheck ? -VALUE_INFINITE : evaluate(board);
+    const int staticEval = inCheck ? -VALUE_INFINITE
+        : std::clamp(correctedEval(thread.history, board, rawEval), -VALUE_MATE_IN_MAX_PLY + 1, VALUE_MATE_IN_MAX_PLY - 1);
+    thread.stack[ply].staticEval = staticEval;
+
+    // Improving: the static eval is better than at our previous move, so margins
+    // that assume a fail high can be tighter
+    const bool improving = !inCheck && ply >= 2 && staticEval > thread.stack[ply - 2].staticEval;
+
+    // Reverse futility pruning: the static eval is so far above beta that no reply is likely to bring it back
+    if (!isPV && !inCheck && depth <= searchParams.reverseFutilityDepth && std::abs(beta) < VALUE_MATE_IN_MAX_PLY
+        && staticEval - searchParams.reverseFutilityMargin * (depth - improving) >= beta) {
+        return staticEval;
+    }
+
+    // Razoring: so far below alpha that only captures could save it, so let quiescence
+    // decide. Quiescence doesn't look at checks, so not when we have one to give.
+    if (!isPV && !inCheck && depth <= searchParams.razoringDepth
+        && staticEval + searchParams.razoringMargin * depth * depth < alpha && !hasCheckingMove(board)) {
+        const int value = quiescence(thread, ply, alpha, alpha + 1);
+        if (value <= alpha) {
+            return value;
+        }
+    }
+
+    // Null move pruning: if we can pass and still beat beta, a real move will too.
+    // Skipped in check and when only pawns are left, where zugzwang makes passing unsound.
+    if (!isPV && allowNull && depth >= NULL_MOVE_MIN_DEPTH && !inCheck && excludedMove == chess::Move::NO_MOVE
+        && board.hasNonPawnMaterial(board.sideToMove())) {
+        if (staticEval >= beta && std::abs(beta) < VALUE_MATE_IN_MAX_PLY) {
+            const int reduction = NULL_MOVE_BASE_REDUCTION + depth / NULL_MOVE_DEPTH_DIVISOR
+                + std::min((staticEval - beta) / NULL_MOVE_EVAL_DIVISOR, NULL_MOVE_MAX_EVAL_REDUCTION);
+            const int nullDepth = std::max(depth - reduction, 0);
+
+            thread.stack[ply + 1].excludedMove = chess::Move::NO_MOVE;
+            thread.stack[ply + 1].extensions = thread.stack[ply].extensions;
+            setCurrentMove(thread, ply, chess::Move::NULL_MOVE);
+
+            board.makeNullMove();
+            int value = -negamax<NodeType::NonPV>(thread, nullDepth - 1, ply + 1, -beta, -beta + 1, false);
+            board.unmakeNullMove();
+
+            if (searchInfo.stopped) {
+                return 0;
+            }
+
+            if (value >= beta) {
+                if (depth < NULL_MOVE_VERIFY_DEPTH) {
+                    return beta;
+                }
+
+                // At high depth confirm with a reduced search of our own moves
+                value = negamax<NodeType::NonPV>(thread, nullDepth, ply, beta - 1, beta, false);
+                if (searchInfo.stopped) {
+                    return 0;
+                }
+                if (value >= beta) {
+                    return beta;
+                }
             }
         }
-    } else {
-        bestValue = INT_MAX;
-        for (int i = 0; i < moves.size(); i++) {
-            const auto move = moves[i];
-            board.makeMove(move);
-            int value = minimax(board, depth - 1, alpha, beta, true);
-            board.unmakeMove(move);
-            bestValue = std::min(bestValue, value);
-            beta = std::min(beta, value);
+    }
+
+    // ProbCut: a good capture that beats beta by a margin at reduced depth will
+    // very likely beat beta at full depth as well. Skipped when the hash entry
+    // already shows a deep enough search failing to reach that margin.
+    const int probCutBeta = beta + searchParams.probCutMargin;
+    if (!isPV && !inCheck && depth >= searchParams.probCutDepth && excludedMove == chess::Move::NO_MOVE
+        && std::abs(beta) < VALUE_MATE_IN_MAX_PLY
+        && !(ttHit && entry.depth >= depth - searchParams.probCutReduction && ttScore < probCutBeta)) {
+        chess::Movelist &captures = thread.stack[ply].captures[moveBuffers(thread, ply)];
+        chess::movegen::legalmoves<chess::movegen::MoveGenType::CAPTURE>(captures, board);
+        for (auto &capture : captures) {
+            capture.setScore(mvvLva(board, capture));
+        }
+        std::sort(captures.begin(), captures.end(),
+                  [](const chess::Move &a, const chess::Move &b) { return a.score() > b.score(); });
+
+        for (const auto &capture : captures) {
+            // Only captures that win back the margin by themselves
+            if (!see(board, capture, probCutBeta - staticEval)) {
+                continue;
+            }
+
+            thread.stack[ply + 1].excludedMove = chess::Move::NO_MOVE;
+            thread.stack[ply + 1].extensions = thread.stack[ply].extensions;
+            setCurrentMove(thread, ply, capture);
+
+            board.makeMove(capture);
+
+            // Confirm with quiescence first, it is cheap and rejects most candidates
+            int value = -quiescence(thread, ply + 1, -probCutBeta, -probCutBeta + 1);
+            if (value >= probCutBeta) {
+                value = -negamax<NodeType::NonPV>(thread, depth - searchParams.probCutReduction - 1, ply + 1,
+                                                  -probCutBeta, -probCutBeta + 1);
+            }
+
+            board.unmakeMove(capture);
+
+            if (searchInfo.stopped) {
+                return 0;
+            }
 
-            if (beta <= alpha) {
+            if (value >= probCutBeta) {
+                thread.table->store(key, depth - searchParams.probCutReduction, BOUND_LOWER, scoreToTT(value, ply), capture);
+                return value;
+            }
+        }
+    }
+
+    PieceToHistory *continuation[2];
+    continuationTables(thread, ply, continuation);
+
+    chess::Move counterMove = chess::Move::NO_MOVE;
+    if (ply > 0 && thread.stack[ply - 1].movedPiece != chess::Piece::NONE) {
+        counterMove = thread.history.counterMoves[thread.stack[ply - 1].movedPiece][thread.stack[ply - 1].currentMove.to().index()];
+    }
+
+    const int buffers = moveBuffers(thread, ply);
+    MovePicker picker(board, ttMove, thread.stack[ply].killers, counterMove, thread.history, continuation,
+                      thread.stack[ply].captures[buffers], thread.stack[ply].quiets[buffers]);
+
+    int bestValue = -VALUE_INFINITE;
+    chess::Move bestMove = chess::Move::NO_MOVE;
+    chess::Move move;
+    int moveCount = 0;
+
+    chess::Movelist &quietsTried = thread.stack[ply].quietsTried;
+    chess::Movelist &capturesTried = thread.stack[ply].capturesTried;
+    quietsTried.clear();
+    capturesTried.clear();
+
+    while (true) {
+        if constexpr (isRoot) {
+            if (thread.pvIndex + moveCount == (int)thread.rootMoves.size()) {
+                break;
+            }
+            move = thread.rootMoves[thread.pvIndex + moveCount].move;
+        } else {
+            move = picker.next();
+            if (move == chess::Move::NO_MOVE) {
                 break;
             }
         }
+
+        if (move == excludedMove) {
+            continue;
+        }
+
+        moveCount++;
+
+        const bool isQuiet = !board.isCapture(move) && move.typeOf() != chess::Move::PROMOTION;
+        const bool isKiller = move == thread.stack[ply].killers[0] || move == thread.stack[ply].killers[1];
+        const int historyScore = isQuiet ? quietHistoryScore(board, thread.history, continuation, move) : 0;
+
+        // Only prune once one move has been searched and we aren't being mated on every line
+        const bool canPrune = !isRoot && !inCheck && isQuiet && moveCount > 1 && bestValue > -VALUE_MATE_IN_MAX_PLY;
+
+        // Late move pruning: deep into the move list at low depth, the remaining quiets are skipped
+        if (canPrune && depth <= searchParams.lateMovePruningDepth
+            && moveCount > searchParams.lateMovePruningBase + depth * depth) {
+            picker.skipQuiets();
+            continue;
+        }
+
+        int extension = 0;
+        const bool canExtend = thread.stack[ply].extensions < MAX_EXTENSIONS;
+
+        // Singular extension: if every other move fails well below the hash score,
+        // the hash move is the only good one and gets searched one ply deeper
+        if (!isRoot && canExtend && move == ttMove && depth >= SINGULAR_MIN_DEPTH && excludedMove == chess::Move::NO_MOVE
+            && (entry.bound == BOUND_LOWER || entry.bound == BOUND_EXACT)
+            && entry.depth >= depth - SINGULAR_TT_DEPTH_MARGIN && std::abs(ttScore) < VALUE_MATE_IN_MAX_PLY) {
+            const int singularBeta = ttScore - SINGULAR_MARGIN * depth;
+
+            thread.stack[ply].excludedMove = move;
+            const int value = negamax<NodeType::NonPV>(thread, (depth - 1) / 2, ply, singularBeta - 1, singularBeta, false);
+            thread.stack[ply].excludedMove = chess::Move::NO_MOVE;
+
+            // The verification search ran on this ply's stack entry, before any move here was tried
+            quietsTried.clear();
+            capturesTried.clear();
+
+            if (searchInfo.stopped) {
+                return 0;
+            }
+
+            if (value < singularBeta) {
+                extension = 1;
+            } else if (singularBeta >= beta) {
+                // Multi-cut: even without the hash move this node fails high
+                return singularBeta;
+            }
+        }
+
+        setCurrentMove(thread, ply, move);
+
+        const uint64_t nodesBefore = thread.nodes;
+        board.makeMove(move);
+        const bool givesCheck = board.inCheck();
+
+        // Check extension
+        if (canExtend && givesCheck) {
+            extension = 1;
+        }
+
+        const int newDepth = depth - 1 + extension;
+        thread.stack[ply + 1].excludedMove = chess::Move::NO_MOVE;
+        thread.stack[ply + 1].extensions = thread.stack[ply].extensions + extension;
+
+        // Futility pruning: a quiet move at a frontier node can't lift a hopeless static eval above alpha
+        if (canPrune && !givesCheck && extension == 0 && depth <= searchParams.futilityDepth) {
+            const int futilityValue = staticEval + searchParams.futilityBase + searchParams.futilityMargin * depth;
+            if (futilityValue <= alpha) {
+                board.unmakeMove(move);
+                bestValue = std::max(bestValue, futilityValue);
+                continue;
+            }
+        }
+
+        int value = 0;
+        bool fullSearch = !isPV || moveCount > 1;
+
+        // Late quiet moves rarely beat the earlier ones, so first try them at reduced
+        // depth with a null window and only pay for the full search if they beat alpha
+        if (!isRoot && depth >= LMR_MIN_DEPTH && moveCount > LMR_MIN_MOVES && isQuiet && !inCheck) {
+            int reduction = reductions[std::min(depth, 63)][std::min(moveCount, 63)];
+            if (givesCheck) {
+                reduction--;
+            }
+            if (isKiller) {
+                reduction--;
+            }
+            if (historyScore > LMR_HISTORY_THRESHOLD) {
+                reduction--;
+            } else if (historyScore < -LMR_HISTORY_THRESHOLD) {
+                reduction++;
+            }
+            reduction = std::clamp(reduction, 0, newDepth - 1);
+
+            if (reduction > 0) {
+                value = -negamax<NodeType::NonPV>(thread, newDepth - reduction, ply + 1, -alpha - 1, -alpha);
+                fullSearch = value > alpha;
+            }
+        }
+
+        // Principal variation search: outside the first move of a PV node a null
+        // window is enough to show a move can't beat alpha
+        if (fullSearch) {
+            value = -negamax<NodeType::NonPV>(thread, newDepth, ply + 1, -alpha - 1, -alpha);
+        }
+
+        if (isPV && (moveCount == 1 || (value > alpha && value < beta))) {
+            value = -negamax<NodeType::PV>(thread, newDepth, ply + 1, -beta, -alpha);
+        }
+
+        board.unmakeMove(move);
+
+        if (searchInfo.stopped) {
+            return 0;
+        }
+
+        if constexpr (isRoot) {
+            RootMove &rootMove = thread.rootMoves[thread.pvIndex + moveCount - 1];
+            rootMove.score = value;
+            rootMove.nodes += thread.nodes - nodesBefore;
+            if (moveCount == 1 || value > alpha) {
+                rootMove.pv.assign(1, move);
+                rootMove.pv.insert(rootMove.pv.end(), thread.pvTable[1], thread.pvTable[1] + thread.pvLength[1]);
+            }
+        }
+
+        if (value > bestValue) {
+            bestValue = value;
+            bestMove = move;
+
+            if (value > alpha) {
+                alpha = value;
+                if constexpr (isPV) {
+                    updatePV(thread, ply, move);
+                }
+            }
+        }
+
+        if (alpha >= beta) {
+            updateHistories(thread, move, depth, ply, quietsTried, capturesTried);
+            break;
+        }
+
+        if (isQuiet) {
+            quietsTried.add(move);
+        } else if (board.isCapture(move)) {
+            capturesTried.add(move);
+        }
+    }
+
+    // No legal moves: checkmate or stalemate, unless the only move was excluded
+    if (moveCount == 0) {
+        if (excludedMove != chess::Move::NO_MOVE) {
+            return alpha;
+        }
+        return inCheck ? -VALUE_MATE + ply : VALUE_DRAW;
+    }
+
+    if constexpr (isRoot) {
+        // Best moves first so the next search tries them first
+        std::stable_sort(thread.rootMoves.begin() + thread.pvIndex, thread.rootMoves.end(),
+                         [](const RootMove &a, const RootMove &b) { return a.score > b.score; });
+    }
+
+    Bound bound = BOUND_EXACT;
+    if (bestValue <= alphaOrig) {
+        bound = BOUND_UPPER;
+    } else if (bestValue >= beta) {
+        bound = BOUND_LOWER;
+    }
+    if (excludedMove == chess::Move::NO_MOVE) {
+        thread.table->store(key, depth, bound, scoreToTT(bestValue, ply), bestMove);
+
+        // Learn from quiet positions where the bound says something about the eval's error
+        if (!inCheck && (bestMove == chess::Move::NO_MOVE || !board.isCapture(bestMove))
+            && std::abs(bestValue) < VALUE_MATE_IN_MAX_PLY
+            && !(bound == BOUND_LOWER && bestValue <= staticEval)
+            && !(bound == BOUND_UPPER && bestValue >= staticEval)) {
+            updateCorrection(thread.history, board, depth, bestValue - rawEval);
+        }
+    }
+
+    return bestValue;
+}
+
+// Draws by the fifty move rule, insufficient material or repetition. A single
+// repetition inside the search path is enough, positions from the game before
+// the root have to have occurred twice.
+bool isDraw(SearchThread &thread, int ply) {
+    const chess::Board &board = thread.board;
+
+    if (board.isHalfMoveDraw()) {
+        return board.getHalfMoveDrawType().second == chess::GameResult::DRAW;
+    }
+
+    if (board.isInsufficientMaterial()) {
+        return true;
+    }
+
+    if (!board.isRepetition(1)) {
+        return false;
+    }
+
+    if (board.isRepetition(2)) {
+        return true;
+    }
+
+    for (int i = ply - 2; i >= 0; i -= 2) {
+        if (thread.stack[i].key == thread.stack[ply].key) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Mate scores are stored relative to the node instead of the root, so they
+// stay correct when the position is reached at a different ply
+int scoreToTT(int score, int ply) {
+    if (score >= VALUE_MATE_IN_MAX_PLY) {
+        return score + ply;
+    }
+    if (score <= -VALUE_MATE_IN_MAX_PLY) {
+        return score - ply;
+    }
+    return score;
+}
+
+int scoreFromTT(int score, int ply) {
+    if (score >= VALUE_MATE_IN_MAX_PLY) {
+        return score - ply;
+    }
+    if (score <= -VALUE_MATE_IN_MAX_PLY) {
+        return score + ply;
+    }
+    return score;
+}
+
+// Rewards the move that caused a beta cutoff and punishes the moves of the same
+// kind that were searched before it without one
+void updateHistories(SearchThread &thread, chess::Move bestMove, int depth, int ply, const chess::Movelist &quietsTried,
+                     const chess::Movelist &capturesTried) {
+    const chess::Board &board = thread.board;
+    HistoryTables &history = thread.history;
+    const int color = (int)board.sideToMove();
+    const int bonus = historyBonus(depth);
+
+    PieceToHistory *continuation[2];
+    continuationTables(thread, ply, continuation);
+
+    auto updateQuiet = [&](chess::Move move, int amount) {
+        const chess::Piece piece = board.at(move.from());
+        updateHistory(history.butterfly[color][move.from().index()][move.to().index()], amount);
+        for (PieceToHistory *table : continuation) {
+            if (table) {
+                updateHistory((*table)[piece][move.to().index()], amount);
+            }
+        }
+    };
+
+    auto updateCapture = [&](chess::Move move, int amount) {
+        const chess::Piece piece = board.at(move.from());
+        updateHistory(history.captures[piece][move.to().index()][capturedType(board, move)], amount);
+    };
+
+    const bool bestIsQuiet = !board.isCapture(bestMove) && bestMove.typeOf() != chess::Move::PROMOTION;
+
+    if (bestIsQuiet) {
+        chess::Move (&killers)[2] = thread.stack[ply].killers;
+        if (killers[0] != bestMove) {
+            killers[1] = killers[0];
+            killers[0] = bestMove;
+        }
+
+        if (ply > 0 && thread.stack[ply - 1].movedPiece != chess::Piece::NONE) {
+            history.counterMoves[thread.stack[ply - 1].movedPiece][thread.stack[ply - 1].currentMove.to().index()] = bestMove;
+        }
+
+        updateQuiet(bestMove, bonus);
+        for (const auto &move : quietsTried) {
+            updateQuiet(move, -bonus);
+        }
+    } else if (board.isCapture(bestMove)) {
+        updateCapture(bestMove, bonus);
+    }
+
+    for (const auto &move : capturesTried) {
+        updateCapture(move, -bonus);
+    }
+}
+
+// Continuation history tables for the moves one and two plies before this one,
+// null where there is no such move or it was a null move
+void continuationTables(SearchThread &thread, int ply, PieceToHistory *(&tables)[2]) {
+    for (int i = 0; i < 2; i++) {
+        const int previous = ply - 1 - i;
+        tables[i] = nullptr;
+
+        if (previous >= 0) {
+            tables[i] = thread.stack[previous].continuationHistory;
+        }
+    }
+}
+
+// A new best move at a PV node: its line is the move followed by the child's line
+void updatePV(SearchThread &thread, int ply, chess::Move move) {
+    thread.pvTable[ply][0] = move;
+    std::copy(thread.pvTable[ply + 1], thread.pvTable[ply + 1] + thread.pvLength[ply + 1], thread.pvTable[ply] + 1);
+    thread.pvLength[ply] = thread.pvLength[ply + 1] + 1;
+}
+
+// Records the move made from ply, NULL_MOVE for a null move
+void setCurrentMove(SearchThread &thread, int ply, chess::Move move) {
+    StackEntry &entry = thread.stack[ply];
+    entry.currentMove = move;
+    entry.movedPiece = move == chess::Move::NULL_MOVE ? chess::Piece::NONE : thread.board.at(move.from());
+    entry.continuationHistory = entry.movedPiece == chess::Piece::NONE
+        ? nullptr
+        : &thread.history.continuation[entry.movedPiece][move.to().index()];
+}
+
+void clearMoveOrdering(SearchThread &thread) {
+    for (auto &entry : thread.stack) {
+        entry.killers[0] = chess::Move::NO_MOVE;
+        entry.killers[1] = chess::Move::NO_MOVE;
+    }
+
+    thread.history.age();
+}
+
+int quiescence(SearchThread &thread, int ply, int alpha, int beta) {
+    if (checkLimits(thread)) {
+        return 0;
+    }
+
+    chess::Board &board = thread.board;
+    if (ply >= MAX_PLY - 1) {
+        return evaluate(board);
+    }
+
+    // Stand pat: the side to move can usually do at least as well as the static eval
+    const int standPat = evaluate(board);
+    int bestValue = standPat;
+    if (bestValue >= beta) {
+        return bestValue;
+    }
+    alpha = std::max(alpha, bestValue);
+
+    const int buffers = moveBuffers(thread, ply);
+    chess::Movelist &moves = thread.stack[ply].captures[buffers];
+    chess::movegen::legalmoves<chess::movegen::MoveGenType::CAPTURE>(moves, board);
+
+    // Non-capturing promotions are generated as quiet moves
+    const chess::Color color = board.sideToMove();
+    const int promotionRank = color == chess::Color::WHITE ? 6 : 1;
+    if (board.pieces(chess::PieceType::PAWN, color) & chess::attacks::MASK_RANK[promotionRank]) {
+        chess::Movelist &quiets = thread.stack[ply].quiets[buffers];
+        chess::movegen::legalmoves<chess::movegen::MoveGenType::QUIET>(quiets, board, chess::PieceGenType::PAWN);
+
+        for (const auto &move : quiets) {
+            if (move.typeOf() == chess::Move::PROMOTION && move.promotionType() == chess::PieceType::QUEEN) {
+                moves.add(move);
+            }
+        }
+    }
+
+    for (auto &move : moves) {
+        move.setScore(mvvLva(board, move));
+    }
+    std::sort(moves.begin(), moves.end(), [](const chess::Move &a, const chess::Move &b) {
+        return a.score() > b.score();
+    });
+
+    for (const auto &move : moves) {
+        // Skip losing captures, and captures whose exchange can't bring the stand pat
+        // score within deltaMargin of alpha (delta pruning)
+        if (move.typeOf() != chess::Move::PROMOTION
+            && !see(board, move, std::max(0, alpha - standPat - searchParams.deltaMargin + 1))) {
+            continue;
+        }
+
+        board.makeMove(move);
+        int value = -quiescence(thread, ply + 1, -beta, -alpha);
+        board.unmakeMove(move);
+
+        if (searchInfo.stopped) {
+            return 0;
+        }
+
+        if (value > bestValue) {
+            bestValue = value;
+            if (value > alpha) {
+                alpha = value;
+            }
+        }
+
+        if (alpha >= beta) {
+            break;
+        }
     }
+
     return bestValue;
 }
 
+// The second pair of buffers belongs to a singular verification search, the
+// first to everything else
+int moveBuffers(const SearchThread &thread, int ply) {
+    return thread.stack[ply].excludedMove != chess::Move::NO_MOVE ? 1 : 0;
+}
+
 int evaluate(chess::Board& board) {
     int eval = 0;
 
@@ -80,5 +1323,5 @@ int evaluate(chess::Board& board) {
         }
     }
 
-    return eval;
+    return board.sideToMove() == chess::Color::WHITE ? eval : -eval;
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "libraries/chess.hpp"
+#include "values.hpp"
+
+bool see(const chess::Board &board, chess::Move move, int threshold);
+
+// Static exchange evaluation: does the sequence of captures on the target square,
+// each side always recapturing with its least valuable attacker and free to stop,
+// win the mover at least threshold? Sliders behind a piece that captured join in
+// as it leaves. The board is never touched, only a private occupancy changes.
+// Pins are ignored.
+bool see(const chess::Board &board, chess::Move move, int threshold) {
+    using namespace chess;
+
+    // Castling can't lose material and promotions are left to the search
+    if (move.typeOf() == Move::CASTLING || move.typeOf() == Move::PROMOTION) {
+        return threshold <= 0;
+    }
+
+    const Square from = move.from();
+    const Square to = move.to();
+    const bool enPassant = move.typeOf() == Move::ENPASSANT;
+
+    // What we win if the exchange stops right after the move
+    int swap = (enPassant ? pieceValues[PieceType(PieceType::PAWN)] : pieceValues[board.at<PieceType>(to)]) - threshold;
+    if (swap < 0) {
+        return false;
+    }
+
+    // What we still have if the moved piece is taken and nothing else happens
+    swap = pieceValues[board.at<PieceType>(from)] - swap;
+    if (swap <= 0) {
+        return true;
+    }
+
+    Bitboard occupied = board.occ() ^ Bitboard::fromSquare(from);
+    if (enPassant) {
+        occupied ^= Bitboard::fromSquare(to.ep_square());
+    }
+
+    const Bitboard queens = board.pieces(PieceType::QUEEN);
+    const Bitboard diagonals = board.pieces(PieceType::BISHOP) | queens;
+    const Bitboard orthogonals = board.pieces(PieceType::ROOK) | queens;
+
+    // attackers() sees the board as it is, the sliders behind the moved piece are added by hand
+    Bitboard attackers = attacks::attackers(board, Color::WHITE, to) | attacks::attackers(board, Color::BLACK, to);
+    attackers |= (attacks::bishop(to, occupied) & diagonals) | (attacks::rook(to, occupied) & orthogonals);
+
+    Color color = board.sideToMove();
+    bool result = true;
+
+    while (true) {
+        color = ~color;
+        attackers &= occupied;
+
+        const Bitboard ours = attackers & board.us(color);
+        if (!ours) {
+            break;
+        }
+
+        result = !result;
+
+        // Least valuable attacker first
+        PieceType attacker = PieceType::NONE;
+        Bitboard candidates;
+        for (PieceType type : {PieceType::PAWN, PieceType::KNIGHT, PieceType::BISHOP, PieceType::ROOK,
+                               PieceType::QUEEN, PieceType::KING}) {
+            candidates = ours & board.pieces(type);
+            if (candidates) {
+                attacker = type;
+                break;
+            }
+        }
+
+        // The king can only take last: if the other side still has an attacker, it can't take at all
+        if (attacker == PieceType::KING) {
+            return (attackers & board.us(~color)) ? !result : result;
+        }
+
+        swap = pieceValues[attacker] - swap;
+        if (swap < (int)result) {
+            break;
+        }
+
+        occupied ^= Bitboard::fromSquare(candidates.lsb());
+
+        if (attacker == PieceType::PAWN || attacker == PieceType::BISHOP || attacker == PieceType::QUEEN) {
+            attackers |= attacks::bishop(to, occupied) & diagonals;
+        }
+        if (attacker == PieceType::ROOK || attacker == PieceType::QUEEN) {
+            attackers |= attacks::rook(to, occupied) & orthogonals;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "libraries/chess.hpp"
+#include <algorithm>
+#include <cstdint>
+
+// What a search may spend, 0 means no limit for every field. A fixed move time
+// and the clocks can both be given, the search then stops at the earlier of the two.
+struct SearchLimits {
+    int depth = 0;
+    uint64_t nodes = 0;
+    int64_t moveTimeMs = 0;
+    // Stop once a mate in this many moves or less is found
+    int mate = 0;
+
+    // Time left on each side's clock, the increment per move, and the moves until
+    // the next time control, 0 for the rest of the game
+    int64_t whiteTimeMs = 0;
+    int64_t blackTimeMs = 0;
+    int64_t whiteIncrementMs = 0;
+    int64_t blackIncrementMs = 0;
+    int movesToGo = 0;
+};
+
+// Share of the clock a move gets when the moves to the next time control are
+// unknown, and what is kept back for the overhead of playing the move
+const int DEFAULT_MOVES_TO_GO = 30;
+const int64_t MOVE_OVERHEAD_MS = 50;
+
+// Most of the remaining clock a single move may take, and how far past its
+// share of the clock it may run when an iteration is already under way
+const int MAX_TIME_PERCENT = 80;
+const int HARD_LIMIT_FACTOR = 4;
+
+// Scaling of the soft limit, only trusted once the iterations are deep enough
+// to say something about the position
+const int TIME_SCALING_MIN_DEPTH = 6;
+const int STABILITY_MAX = 6;
+const double STABILITY_SCALE_MAX = 1.6;
+const double STABILITY_SCALE_STEP = 0.15;
+const int SCORE_DROP_MAX = 100;
+const double SCORE_DROP_SCALE = 0.6;
+const double NODE_SCALE_BASE = 0.5;
+const double NODE_SCALE_FACTOR = 2.0;
+
+// Turns the limits into a hard limit the search is aborted at and, with a
+// clock, a soft limit past which no new iteration is started. The soft limit
+// grows while the best move keeps changing or the score is falling, and
+// shrinks when the best move holds and takes most of the nodes.
+class TimeManager {
+public:
+    void start(const SearchLimits &limits, chess::Color color);
+
+    int64_t softLimitMs() const { return softLimit; }
+    int64_t hardLimitMs() const { return hardLimit; }
+
+    // Called by the main thread after every completed iteration
+    bool stopAfterIteration(int depth, chess::Move bestMove, int score, double bestMoveNodes, int64_t elapsedMs);
+
+private:
+    int64_t softLimit = 0;
+    int64_t hardLimit = 0;
+
+    chess::Move lastBestMove = chess::Move::NO_MOVE;
+    int lastScore = 0;
+    int stability = 0;
+};
+
+TimeManager timeManager;
+
+void TimeManager::start(const SearchLimits &limits, chess::Color color) {
+    softLimit = 0;
+    hardLimit = limits.moveTimeMs;
+    lastBestMove = chess::Move::NO_MOVE;
+    lastScore = 0;
+    stability = 0;
+
+    const bool white = color == chess::Color::WHITE;
+    const int64_t time = white ? limits.whiteTimeMs : limits.blackTimeMs;
+    if (time <= 0) {
+        return;
+    }
+
+    const int64_t increment = white ? limits.whiteIncrementMs : limits.blackIncrementMs;
+    const int movesToGo = limits.movesToGo > 0 ? limits.movesToGo : DEFAULT_MOVES_TO_GO;
+    const int64_t available = std::max<int64_t>(time - MOVE_OVERHEAD_MS, 1);
+    const int64_t maximum = std::max<int64_t>(available * MAX_TIME_PERCENT / 100, 1);
+
+    softLimit = std::clamp<int64_t>(available / movesToGo + increment * 3 / 4, 1, maximum);
+    const int64_t clockLimit = std::min(softLimit * HARD_LIMIT_FACTOR, maximum);
+
+    // A fixed move time is a promise, the clock can only make it shorter
+    hardLimit = hardLimit ? std::min(hardLimit, clockLimit) : clockLimit;
+    softLimit = std::min(softLimit, hardLimit);
+}
+
+// bestMoveNodes is the fraction of the root's nodes spent below the best move
+bool TimeManager::stopAfterIteration(int depth, chess::Move bestMove, int score, double bestMoveNodes,
+                                     int64_t elapsedMs) {
+    stability = bestMove == lastBestMove ? std::min(stability + 1, STABILITY_MAX) : 0;
+    const int drop = lastBestMove == chess::Move::NO_MOVE ? 0 : std::clamp(lastScore - score, 0, SCORE_DROP_MAX);
+    lastBestMove = bestMove;
+    lastScore = score;
+
+    if (!softLimit) {
+        return false;
+    }
+    if (depth < TIME_SCALING_MIN_DEPTH) {
+        return elapsedMs >= softLimit;
+    }
+
+    const double stabilityScale = STABILITY_SCALE_MAX - STABILITY_SCALE_STEP * stability;
+    const double dropScale = 1.0 + SCORE_DROP_SCALE * drop / SCORE_DROP_MAX;
+    const double nodeScale = NODE_SCALE_BASE + NODE_SCALE_FACTOR * (1.0 - std::clamp(bestMoveNodes, 0.0, 1.0));
+
+    const double scaled = softLimit * stabilityScale * dropScale * nodeScale;
+    return elapsedMs >= std::min<double>(scaled, hardLimit);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "libraries/chess.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+enum Bound : uint8_t {
+    BOUND_NONE,
+    BOUND_EXACT,
+    BOUND_LOWER,
+    BOUND_UPPER
+};
+
+struct TTEntry {
+    uint64_t key;
+    int32_t score;
+    uint16_t move;
+    int8_t depth;
+    uint8_t bound;
+};
+
+// Entries are shared between search threads without locks. The key is stored
+// XORed with the packed data, so a slot torn by two concurrent writers no
+// longer matches its position and is simply treated as a miss.
+struct TTSlot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+};
+
+class TranspositionTable {
+public:
+    void resize(size_t megabytes);
+    void clear();
+    bool probe(uint64_t key, TTEntry& entry) const;
+    void store(uint64_t key, int depth, Bound bound, int score, chess::Move move);
+
+private:
+    static uint64_t pack(const TTEntry& entry);
+    static TTEntry unpack(uint64_t key, uint64_t data);
+
+    std::unique_ptr<TTSlot[]> table;
+    size_t size = 0;
+    uint64_t mask = 0;
+};
+
+TranspositionTable tt;
+
+void TranspositionTable::resize(size_t megabytes) {
+    size_t entries = (megabytes * 1024 * 1024) / sizeof(TTSlot);
+
+    // Round down to a power of two so the index is a simple mask of the key
+    size = 1;
+    while (size * 2 <= entries) {
+        size *= 2;
+    }
+
+    table.reset(new TTSlot[size]);
+    mask = size - 1;
+    clear();
+}
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i < size; i++) {
+        table[i].key.store(0, std::memory_order_relaxed);
+        table[i].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool TranspositionTable::probe(uint64_t key, TTEntry& entry) const {
+    if (size == 0) {
+        return false;
+    }
+
+    const TTSlot& slot = table[key & mask];
+    const uint64_t data = slot.data.load(std::memory_order_relaxed);
+    const uint64_t storedKey = slot.key.load(std::memory_order_relaxed);
+
+    if ((storedKey ^ data) != key) {
+        return false;
+    }
+
+    entry = unpack(key, data);
+    return entry.bound != BOUND_NONE;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, Bound bound, int score, chess::Move move) {
+    if (size == 0) {
+        return;
+    }
+
+    TTSlot& slot = table[key & mask];
+
+    TTEntry old;
+    if (probe(key, old)) {
+        // Keep deeper results for the same position unless the new one is exact
+        if (old.depth > depth && bound != BOUND_EXACT) {
+            return;
+        }
+
+        // Don't throw away a known best move just because this search didn't find one
+        if (move == chess::Move::NO_MOVE) {
+            move = old.move;
+        }
+    }
+
+    const uint64_t data = pack(TTEntry{key, score, move.move(), (int8_t)depth, bound});
+    slot.key.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+}
+
+// Layout: score in the high 32 bits, then bound, depth and move
+uint64_t TranspositionTable::pack(const TTEntry& entry) {
+    return ((uint64_t)(uint32_t)entry.score << 32)
+        | ((uint64_t)entry.bound << 24)
+        | ((uint64_t)(uint8_t)entry.depth << 16)
+        | entry.move;
+}
+
+TTEntry TranspositionTable::unpack(uint64_t key, uint64_t data) {
+    TTEntry entry;
+    entry.key = key;
+    entry.score = (int32_t)(uint32_t)(data >> 32);
+    entry.bound = (uint8_t)((data >> 24) & 0xFF);
+    entry.depth = (int8_t)(uint8_t)((data >> 16) & 0xFF);
+    entry.move = (uint16_t)(data & 0xFFFF);
+    return entry;
+}
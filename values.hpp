@@ -0,0 +1,35 @@
+#pragma once
+
+// Values from: https://www.chessprogramming.org/Simplified_Evaluation_Function
+const int PAWN = 100;
+const int KNIGHT = 320;
+const int BISHOP = 330;
+const int ROOK = 500;
+const int QUEEN = 900;
+const int KING = 20000;
+
+const int materialValues[12] = {
+    PAWN,
+    KNIGHT,
+    BISHOP,
+    ROOK,
+    QUEEN,
+    KING,
+    -PAWN,
+    -KNIGHT,
+    -BISHOP,
+    -ROOK,
+    -QUEEN,
+    -KING
+};
+
+// Indexed by chess::PieceType, NONE is worth nothing
+const int pieceValues[7] = {
+    PAWN,
+    KNIGHT,
+    BISHOP,
+    ROOK,
+    QUEEN,
+    KING,
+    0
+};